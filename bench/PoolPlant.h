@@ -0,0 +1,193 @@
+#ifndef __POOLPLANT_H__
+#define __POOLPLANT_H__
+
+// Lumped thermal and hydraulic model of the pool, for running the real
+// firmware against (see bench_plant.cpp).  It sits behind the mock HAL:
+// each step() reads the relay and valve outputs, advances the model to
+// the current virtual time, and sets thermistor ADC codes and water level
+// switch inputs from the new state.  Units are SI, and temperatures 'C.
+//
+//   Heater  -> exchanger loop:  heaterPower, while the relay is on
+//   Exchanger -> pool:          exchangerUA * (Tx - Tpool)
+//   Pool -> ambient:            lossUA * (Tpool - Tair), plus evaporation
+//                               from the uncovered surface (mass and
+//                               latent heat), less solar gain
+//   Refill valve -> pool:       refillFlow, at supplyTemperature
+//
+// Air temperature and sun follow a fixed daily cycle, starting at
+// midnight when the plant is constructed (whatever the virtual time, as
+// other benchmarks may have advanced it).  Thermistor readings get
+// Gaussian noise, from a fixed seed, so runs are repeatable.
+
+#include <NativeHAL.h>
+
+#include <stdint.h>
+#include <math.h>
+
+struct PoolPlantParams {
+  double volume = 3.9;  // m^3 (~1,000 gal; 10 ft inflatable, 30 in deep)
+  double area = 7.3;  // m^2, water surface
+  double cover = 0.9;  // Fraction under a solar cover (no evaporation)
+  double heaterPower = 1500;  // W (110 V, ~14 A), into the exchanger loop
+  double exchangerCapacity = 42e3;  // J/K (~10 l of water)
+  double exchangerUA = 150;  // W/K, exchanger to pool water
+  double exchangerLossUA = 3;  // W/K, exchanger loop to air
+  double lossUA = 60;  // W/K, pool to air (vinyl walls, surface convection)
+  double airMean = 24, airSwing = 5;  // 'C; peak at 15:00
+  double humidity = 0.5;
+  double wind = 0.5;  // m/s
+  double solarPeak = 250;  // W/m^2 absorbed, at noon
+  double refillFlow = 0.25;  // kg/s (15 l/min)
+  double supplyTemperature = 15;  // 'C
+  double levelMid = -0.02, levelHi = 0.0;  // m, where each switch closes
+  double sensorNoise = 0.0008;  // Standard deviation, in divider ratio units
+};
+
+// Where the firmware expects things; sensors are MCU pins, or ADS1115
+// channels.  Thermistors are on the low side of a divider with a
+// reference resistor, and codeScale is ADC codes per unit ratio.
+struct PoolPlantWiring {
+  uint8_t relayPin, valvePin;
+  uint8_t mainSensor, exchangerSensor;
+  bool ads1115;
+  double codeScale;
+  uint16_t maxCode;
+  uint8_t levelHiPin, levelMidPin;  // Active low (closed to ground)
+  double refR, nomR, nomC, beta;
+};
+
+class PoolPlant {
+public:
+  PoolPlant(const PoolPlantParams &params, const PoolPlantWiring &wiring, double startC)
+  : heaterSec(0), heaterJoules(0), relayCycles(0), valveCycles(0), refillKg(0), evaporatedKg(0),
+    _p(params), _w(wiring), _pool(startC), _exchanger(startC), _level(0),
+    _origin(NativeHAL::now()), _last(_origin), _heaterOn(false), _valveOn(false), _seed(0x9e3779b9)
+  {
+    _capacity = _p.volume * 1000.0 * WATER_HEAT;
+    _outputs();
+  }
+
+  // Advance to NativeHAL::now(); call before every loop() pass
+  void step() {
+    uint64_t now = NativeHAL::now();
+    while (_last < now) {
+      uint64_t us = (now - _last < MAX_STEP_US) ? now - _last : MAX_STEP_US;
+      _integrate(us / 1e6);
+      _last += us;
+    }
+    _inputs();
+    _outputs();
+  }
+
+  inline double poolC() const { return _pool; }
+  inline double exchangerC() const { return _exchanger; }
+  inline double level() const { return _level; }  // m, from nominal
+  inline double airC() const { return _air((_last - _origin) / 1e6); }
+
+  // Totals since start
+  double heaterSec;
+  double heaterJoules;
+  unsigned long relayCycles;  // Off to on
+  unsigned long valveCycles;
+  double refillKg;
+  double evaporatedKg;
+
+private:
+  static const uint64_t MAX_STEP_US = 1000000;
+  static constexpr double WATER_HEAT = 4186;  // J/(kg K)
+  static constexpr double LATENT_HEAT = 2.43e6;  // J/kg, at pool temperatures
+
+  const PoolPlantParams _p;
+  const PoolPlantWiring _w;
+  double _capacity;  // J/K
+  double _pool, _exchanger, _level;
+  uint64_t _origin;  // Midnight
+  uint64_t _last;
+  bool _heaterOn, _valveOn;
+  uint32_t _seed;
+
+  static double _saturationKPa(double c) {  // Tetens
+    return 0.61078 * exp(17.27 * c / (c + 237.3));
+  }
+
+  double _air(double sec) const {
+    double hour = fmod(sec / 3600.0, 24.0);
+    return _p.airMean + _p.airSwing * sin(2 * M_PI * (hour - 9) / 24);
+  }
+
+  double _solar(double sec) const {
+    double hour = fmod(sec / 3600.0, 24.0);
+    return (hour > 6 && hour < 18) ? _p.solarPeak * _p.area * sin(M_PI * (hour - 6) / 12) : 0;
+  }
+
+  void _integrate(double dt) {
+    double sec = (_last - _origin) / 1e6;
+    double air = _air(sec);
+
+    // Evaporation (Carrier's equation, kPa and kJ/kg), never negative
+    double vapor = _saturationKPa(_pool) - _p.humidity * _saturationKPa(air);
+    double evaporation = (vapor > 0) ? (1 - _p.cover) * _p.area * (0.089 + 0.0782 * _p.wind) * vapor / (LATENT_HEAT / 1000) : 0;
+    double refill = _valveOn ? _p.refillFlow : 0;
+
+    double heater = _heaterOn ? _p.heaterPower : 0;
+    double transfer = _p.exchangerUA * (_exchanger - _pool);
+    double poolIn = transfer + _solar(sec) - _p.lossUA * (_pool - air)
+      - evaporation * LATENT_HEAT + refill * WATER_HEAT * (_p.supplyTemperature - _pool);
+    double exchangerIn = heater - transfer - _p.exchangerLossUA * (_exchanger - air);
+
+    _pool += poolIn * dt / _capacity;
+    _exchanger += exchangerIn * dt / _p.exchangerCapacity;
+    _level += (refill - evaporation) * dt / (1000.0 * _p.area);
+
+    if (_heaterOn) {
+      heaterSec += dt;
+      heaterJoules += heater * dt;
+    }
+    refillKg += refill * dt;
+    evaporatedKg += evaporation * dt;
+  }
+
+  // Firmware outputs, which hold until the next step
+  void _inputs() {
+    bool heaterOn = NativeHAL::pinLevel(_w.relayPin);
+    bool valveOn = NativeHAL::pinLevel(_w.valvePin);
+    relayCycles += (heaterOn && !_heaterOn);
+    valveCycles += (valveOn && !_valveOn);
+    _heaterOn = heaterOn;
+    _valveOn = valveOn;
+  }
+
+  // Firmware inputs
+  void _outputs() {
+    _sense(_w.mainSensor, _pool);
+    _sense(_w.exchangerSensor, _exchanger);
+    NativeHAL::setDigitalInput(_w.levelHiPin, _level >= _p.levelHi ? 0 : 1);
+    NativeHAL::setDigitalInput(_w.levelMidPin, _level >= _p.levelMid ? 0 : 1);
+  }
+
+  void _sense(uint8_t sensor, double c) {
+    double r = _w.nomR * exp(_w.beta * (1 / (c + 273.15) - 1 / (_w.nomC + 273.15)));
+    double code = (r / (r + _w.refR) + _p.sensorNoise * _gaussian()) * _w.codeScale;
+    code = (code < 0) ? 0 : (code > _w.maxCode) ? _w.maxCode : code;
+    if (_w.ads1115)
+      NativeHAL::setADS1115Input(sensor, (int16_t)lround(code));
+    else
+      NativeHAL::setAnalogInput(sensor, (uint16_t)lround(code));
+  }
+
+  // Box-Muller, over xorshift32
+  double _gaussian() {
+    double u1 = (_random() + 1.0) / 4294967297.0;
+    double u2 = _random() / 4294967296.0;
+    return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+  }
+
+  uint32_t _random() {
+    _seed ^= _seed << 13;
+    _seed ^= _seed >> 17;
+    _seed ^= _seed << 5;
+    return _seed;
+  }
+};
+
+#endif /* __POOLPLANT_H__ */
@@ -0,0 +1,51 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+// Minimal host micro-benchmark harness (env:native_bench).  Each BENCH()
+// body runs its kernel n times; the driver picks n so that a run takes at
+// least BENCH_MIN_SEC of wall-clock time, and reports time and heap
+// allocations (via operator new) per iteration.
+
+#include <stdint.h>
+
+namespace bench {
+
+typedef void (*bench_fn_t)(uint64_t n);
+
+struct Case {
+  const char *name;
+  bench_fn_t fn;
+  bool once;  // Not timed; run once, for its notes
+  Case *next;
+};
+
+struct Registrar {
+  Registrar(const char *name, bench_fn_t fn, bool once = false);
+};
+
+// Extra (non-timing) result line, e.g. an error bound
+void note(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+// Heap allocations (operator new) since start
+uint64_t allocations();
+
+// Keeps the compiler from optimizing away a computed value
+template <typename T>
+inline void keep(const T &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+}  // namespace bench
+
+#define BENCH(name) \
+  static void bench_##name(uint64_t n); \
+  static bench::Registrar _bench_registrar_##name(#name, bench_##name); \
+  static void bench_##name(uint64_t n)
+
+// Accuracy checks and the like, reported via bench::note()
+#define BENCH_ONCE(name) \
+  static void bench_##name(uint64_t n); \
+  static bench::Registrar _bench_registrar_##name(#name, bench_##name, true); \
+  static void bench_##name(uint64_t n __attribute__((unused)))
+
+#endif /* __BENCH_H__ */
@@ -0,0 +1,188 @@
+#include <Arduino.h>
+#include <Thermistor.h>
+#include <NativeHAL.h>
+
+#include <cmath>
+
+#include "bench.h"
+
+// Same sensor parameters as main.cpp
+static const double REF_R = 10000.0, NOM_R = 10000.0, NOM_T = 25.0 + 273.15, BETA = 3950.0;
+
+static double _fahrenheit(double ratio) {
+  double invT = 1.0/NOM_T + (std::log(REF_R/NOM_R) - std::log(1.0/ratio - 1.0))/BETA;
+  return 1.8 * (1.0/invT - 273.15) + 32.0;
+}
+
+static double _ratio(double fahrenheit) {
+  double tempK = (fahrenheit - 32.0)/1.8 + 273.15;
+  double r = NOM_R * std::exp(BETA * (1.0/tempK - 1.0/NOM_T));
+  return 1.0 / (1.0 + REF_R/r);
+}
+
+/***************************************************************************
+ * Synthetic traces: true temperature, plus white ADC noise and
+ * occasional spikes (e.g., WiFi TX bursts coupling into the ADC)
+ ***************************************************************************/
+
+typedef struct {
+  const char *name;
+  double noise;  // Std dev, in ratio units (1 LSB of 12 bits is 0.00024)
+  double spikeProb;  // Per sample
+  double spikeSize;  // Ratio units
+  double driftPerHour;  // 'F
+} trace_t;
+
+static const trace_t TRACES[] = {
+  { "quiet", 0.0005, 0.002, 0.03, 0.0 },  // ~0.08'F noise
+  { "noisy", 0.003, 0.02, 0.05, 0.0 },  // ~0.5'F noise
+  { "heating", 0.001, 0.005, 0.03, 2.0 },
+};
+
+static const double READING_INTERVAL_SEC = 5.0;  // As THERMOSTAT_UPDATE_INTERVAL_SEC
+static const unsigned TRACE_READINGS = 1440;  // 2 hours
+
+// Deterministic PRNG, so every filter sees the same trace
+class TraceRandom {
+public:
+  TraceRandom() : _state(12345) { }
+  double uniform() {
+    _state = _state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return ((_state >> 11) + 0.5) / 9007199254740992.0;
+  }
+  double gaussian() {
+    return std::sqrt(-2.0 * std::log(uniform())) * std::cos(2 * M_PI * uniform());
+  }
+private:
+  uint64_t _state;
+};
+
+template <typename T>
+class TracePort : public BasicADCPort<T> {
+public:
+  TracePort(const trace_t &trace, uint8_t nSamples)
+  : BasicADCPort<T>(T(1), nSamples, 0), _trace(trace), _truth(0) { }
+
+  inline void setTruth(double ratio) { _truth = ratio; }
+
+  virtual T acquire() override {
+    double x = _truth + _trace.noise * _random.gaussian();
+    if (_random.uniform() < _trace.spikeProb)
+      x += (_random.uniform() < 0.5 ? -1 : 1) * _trace.spikeSize;
+    return T(x);
+  }
+
+private:
+  const trace_t &_trace;
+  double _truth;
+  TraceRandom _random;
+};
+
+typedef struct {
+  double conversions;  // Per reading
+  double rmsError, maxError;  // 'F
+} trace_result_t;
+
+static trace_result_t _runTrace(const trace_t &trace, ADCFilter<float> *filter, uint8_t nSamples) {
+  TracePort<float> port(trace, nSamples);
+  port.setFilter(filter);
+  double sumSq = 0, maxErr = 0;
+  for (unsigned i = 0;  i < TRACE_READINGS;  i++) {
+    double hours = i * READING_INTERVAL_SEC / 3600;
+    double truthF = 84.0 + trace.driftPerHour * hours + 0.5 * std::sin(2 * M_PI * hours / 2);
+    port.setTruth(_ratio(truthF));
+    port.request();
+    while (!port.ready())
+      port.sample(0);
+    double err = std::fabs(_fahrenheit(port.read()) - truthF);
+    sumSq += err * err;
+    maxErr = std::max(maxErr, err);
+  }
+  trace_result_t r = { (double)port.totalSamples() / TRACE_READINGS, std::sqrt(sumSq / TRACE_READINGS), maxErr };
+  return r;
+}
+
+// Filter settings compared (as could be used in main.cpp)
+static const uint8_t N_SAMPLES = 5;  // ADCPortBase::DEFAULT_SAMPLES
+static const float TOLERANCE = 0.0006;  // Standard error, ~0.1'F at 84'F
+static const float KALMAN_Q = 0.0001 * 0.0001;  // Per reading; ~0.016'F random walk
+static const float KALMAN_R = 0.002 * 0.002;
+
+BENCH_ONCE(filter_trace_error) {
+  bench::note("%-8s %-10s %8s %10s %10s", "trace", "filter", "conv/rd", "rms 'F", "max 'F");
+  for (const trace_t &trace : TRACES) {
+    MedianFilter<float> median;
+    AdaptiveFilter<float> adaptive(TOLERANCE);
+    KalmanFilter<float> kalman1(KALMAN_Q, KALMAN_R), kalman2(KALMAN_Q, KALMAN_R);
+    struct { const char *name; ADCFilter<float> *filter; uint8_t nSamples; } configs[] = {
+      { "mean", NULL, N_SAMPLES },
+      { "median", &median, N_SAMPLES },
+      { "adaptive", &adaptive, N_SAMPLES },
+      { "kalman/1", &kalman1, 1 },
+      { "kalman/2", &kalman2, 2 },
+    };
+    for (auto &c : configs) {
+      trace_result_t r = _runTrace(trace, c.filter, c.nSamples);
+      bench::note("%-8s %-10s %8.2f %10.3f %10.3f", trace.name, c.name, r.conversions, r.rmsError, r.maxError);
+    }
+  }
+}
+
+// Cost of one 5-sample measurement (samples are precomputed)
+template <typename F>
+static void _filterCost(F *filter, uint64_t n) {
+  static float samples[256];
+  TraceRandom random;
+  for (unsigned i = 0;  i < 256;  i++)
+    samples[i] = 0.5 + 0.003 * random.gaussian();
+  for (uint64_t i = 0;  i < n;  i++) {
+    filter->reset();
+    uint8_t count = 0;
+    do {
+      filter->add(samples[(i * 5 + count) & 255]);
+    } while (!filter->complete(++count, N_SAMPLES));
+    bench::keep(filter->result());
+  }
+}
+
+BENCH(filter_median) {
+  MedianFilter<float> f;
+  _filterCost(&f, n);
+}
+
+BENCH(filter_adaptive) {
+  AdaptiveFilter<float> f(TOLERANCE);
+  _filterCost(&f, n);
+}
+
+BENCH(filter_kalman) {
+  KalmanFilter<float> f(KALMAN_Q, KALMAN_R);
+  _filterCost(&f, n);
+}
+
+// Full measurement through an MCU port (mock analogRead()), as main.cpp
+// takes them: request(), then sample() until ready()
+static const uint8_t MEASURE_PIN = 34;  // MAIN_THERMISTOR_PIN
+
+template <typename T>
+static void _measure(BasicMCUPort<T> *port, uint64_t n) {
+  for (uint64_t i = 0;  i < n;  i++) {
+    NativeHAL::setAnalogInput(MEASURE_PIN, 2000 + (i & 63));
+    port->request();
+    while (!port->ready())
+      port->sample(0);
+    bench::keep(port->read());
+  }
+}
+
+BENCH(adc_measure_average) {
+  BasicMCUPort<float> port(MEASURE_PIN);
+  _measure(&port, n);
+}
+
+BENCH(adc_measure_adaptive) {
+  AdaptiveFilter<float> f(TOLERANCE);
+  BasicMCUPort<float> port(MEASURE_PIN);
+  port.setFilter(&f);
+  _measure(&port, n);
+}
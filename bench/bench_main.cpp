@@ -0,0 +1,134 @@
+#include <NativeHAL.h>
+
+#include "bench.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <new>
+
+static const double BENCH_MIN_SEC = 0.2;
+
+static bool _json = false;  // One JSON object per line, instead of text
+static const char *_current = NULL;  // Case being run, for notes
+
+static bench::Case *_cases = NULL;
+static bench::Case **_casesTail = &_cases;
+
+bench::Registrar::Registrar(const char *name, bench_fn_t fn, bool once) {
+  // Keep registration (i.e., file) order
+  static bench::Case storage[64];
+  static unsigned nCases = 0;
+  if (nCases >= sizeof(storage)/sizeof(storage[0]))
+    return;
+  bench::Case *c = &storage[nCases++];
+  c->name = name;
+  c->fn = fn;
+  c->once = once;
+  c->next = NULL;
+  *_casesTail = c;
+  _casesTail = &c->next;
+}
+
+// Count heap allocations; everything in the mock HAL (e.g., String)
+// allocates through operator new
+static uint64_t _allocations = 0;
+
+uint64_t bench::allocations() {
+  return _allocations;
+}
+
+void *operator new(size_t size) {
+  _allocations++;
+  void *p = malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+// Only needs to handle what names and notes contain
+static void _jsonString(const char *s) {
+  putchar('"');
+  for (;  *s;  s++) {
+    if ((unsigned char)*s < ' ')
+      continue;
+    if (*s == '"' || *s == '\\')
+      putchar('\\');
+    putchar(*s);
+  }
+  putchar('"');
+}
+
+void bench::note(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  if (_json) {
+    char text[256];
+    vsnprintf(text, sizeof(text), fmt, args);
+    printf("{\"name\": ");
+    _jsonString(_current);
+    printf(", \"note\": ");
+    _jsonString(text);
+    printf("}\n");
+  } else {
+    printf("# ");
+    vprintf(fmt, args);
+    printf("\n");
+  }
+  va_end(args);
+}
+
+static double _elapsed(bench::bench_fn_t fn, uint64_t n) {
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  fn(n);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
+}
+
+// Usage: bench [-j] [SUBSTRING]  -- runs only cases whose name contains
+// SUBSTRING; -j prints JSON lines, e.g. for etc/bench_compare.py
+int main(int argc, char **argv) {
+  if (argc > 1 && !strcmp(argv[1], "-j")) {
+    _json = true;
+    argc--;
+    argv++;
+  }
+  const char *filter = (argc > 1) ? argv[1] : NULL;
+  NativeHAL::verbose = false;  // Silence Serial debug output
+  for (bench::Case *c = _cases;  c;  c = c->next) {
+    if (filter && !strstr(c->name, filter))
+      continue;
+    _current = c->name;
+    if (c->once) {
+      c->fn(1);
+      continue;
+    }
+    uint64_t n = 1;
+    uint64_t allocs;
+    double sec;
+    do {
+      n *= 2;
+      allocs = _allocations;
+      sec = _elapsed(c->fn, n);
+      allocs = _allocations - allocs;
+    } while (sec < BENCH_MIN_SEC);
+    if (_json) {
+      printf("{\"name\": ");
+      _jsonString(c->name);
+      printf(", \"ns_per_op\": %.1f, \"allocs_per_op\": %.2f, \"n\": %llu}\n",
+        1e9 * sec / n, (double)allocs / n, (unsigned long long)n);
+    } else {
+      printf("%-36s %12.1f ns/op %8.2f allocs/op  (n=%llu)\n",
+        c->name, 1e9 * sec / n, (double)allocs / n, (unsigned long long)n);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,190 @@
+// Includes the firmware itself, to reach its (static) MQTT callback; the
+// native_bench environment does not build src/, so there is no clash
+#include "../src/main.cpp"
+
+#include "bench.h"
+
+/***************************************************************************
+ * Previous callback: String copy, strcmp chain and atof
+ ***************************************************************************/
+
+static control_state_t _legacyParseControlState(String state) {
+  if (state == "on" || state == "auto") {
+    return CONTROL_AUTO;
+  } else if (state == "manual") {
+    return CONTROL_MANUAL;
+  }
+  return CONTROL_OFF;
+}
+
+static void legacy_mqtt_callback(const char *topic, const byte *payload, unsigned int length) {
+  // Safely copy payload bytes into a string
+  String data((const char *)NULL);  // Needs cast, otherwise treats arg as (int)0 ?!
+  data.reserve(length);  // We do not need to +1 for '\0'
+  for (unsigned int i = 0;  i < length; i++)
+    data.concat((char)(payload[i]));
+
+  LOG_D(MQTT, "Received: topic: '%s' / payload: '%s'", topic, data.c_str());
+
+  command_t cmd;
+  if (!strcmp(topic, MQTT_TOPIC_HEATER_CONTROL)) {
+    cmd.type = CMD_HEATER_CONTROL;
+    cmd.state = _legacyParseControlState(data);
+  }
+  else if (!strcmp(topic, MQTT_TOPIC_RELAY_CONTROL)) {
+    cmd.type = CMD_RELAY;
+    cmd.on = (data == "on");
+  }
+  else if (!strcmp(topic, MQTT_TOPIC_REFILL_CONTROL)) {
+    cmd.type = CMD_REFILL_CONTROL;
+    cmd.state = _legacyParseControlState(data);
+  }
+  else if (!strcmp(topic, MQTT_TOPIC_VALVE_CONTROL)) {
+    cmd.type = CMD_VALVE;
+    cmd.on = (data == "on");
+  }
+  else if (!strcmp(topic, MQTT_TOPIC_MAIN_SETPOINT)) {
+    cmd.type = CMD_MAIN_SETPOINT;
+    cmd.value = (float)atof(data.c_str());
+  }
+  else {
+    LOG_W(MQTT, "Unknown topic: %s", topic);
+    return;
+  }
+  _postCommand(cmd);
+}
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+
+typedef struct {
+  const char *topic;
+  const char *payload;
+} bench_message_t;
+
+// Mix of commands, plus an unknown topic and an oversized payload (the
+// latter defeats the small-string optimization of the host's String)
+static const bench_message_t MESSAGES[] = {
+  { MQTT_TOPIC_HEATER_CONTROL, "auto" },
+  { MQTT_TOPIC_RELAY_CONTROL, "on" },
+  { MQTT_TOPIC_MAIN_SETPOINT, "87.5" },
+  { MQTT_TOPIC_REFILL_CONTROL, "manual" },
+  { MQTT_TOPIC_VALVE_CONTROL, "off" },
+  { MQTT_REALM "/unknown/topic", "1" },
+  { MQTT_TOPIC_HEATER_CONTROL, "not-a-valid-control-state" },
+  { MQTT_TOPIC_MAIN_SETPOINT, "86" },
+};
+static const unsigned N_MESSAGES = sizeof(MESSAGES) / sizeof(MESSAGES[0]);
+
+// Both callbacks have the same LOG_D line, which compiles to nothing
+// unless LOG_LEVEL_MQTT is LOG_DEBUG (then it is a vsnprintf into the log
+// ring, most of the time per message; nothing drains it here, so once
+// full, messages are only counted as dropped)
+template <void (*CALLBACK)(const char *, const byte *, unsigned int)>
+static void _dispatch(uint64_t n) {
+  static unsigned lengths[N_MESSAGES];
+  for (unsigned i = 0;  i < N_MESSAGES;  i++)
+    lengths[i] = strlen(MESSAGES[i].payload);
+  command_t cmd;
+  for (uint64_t i = 0;  i < n;  i++) {
+    const bench_message_t &m = MESSAGES[i % N_MESSAGES];
+    CALLBACK(m.topic, (const byte *)m.payload, lengths[i % N_MESSAGES]);
+    while (commandQueue.pop(cmd))
+      bench::keep(cmd);
+  }
+}
+
+BENCH(mqtt_callback_legacy) {
+  _dispatch<legacy_mqtt_callback>(n);
+}
+
+BENCH(mqtt_callback_table) {
+  _dispatch<mqtt_callback>(n);
+}
+
+/***************************************************************************
+ * Telemetry and display, from a status snapshot
+ ***************************************************************************/
+
+// Temperatures cycle over this many values, so every op formats a new one
+static const unsigned N_TEMPERATURES = 64;
+
+static float _temperature(uint64_t i) {
+  return 80.0f + 0.25f * (i % N_TEMPERATURES);
+}
+
+// Connect the mock broker, so publishes go out (and, with verbose off,
+// stop in NativeHAL) instead of piling up in the outbox; disconnected
+// again afterwards, for setup() in the plant bench
+static bool _connect() {
+  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+  NativeHAL::advance(2000000);
+  WiFi.status();
+  return mqttClient.connect("bench");
+}
+
+static void _disconnect() {
+  mqttClient.disconnect();
+  WiFi.disconnect();
+}
+
+static uint64_t _published = 0;
+
+static void _countPublish(const char *, const uint8_t *, unsigned int) {
+  _published++;
+}
+
+// Every reading is due on every call, as if its min interval had passed
+static void _resetReports() {
+  mainTempReport.reset();
+#ifdef HAS_HEAT_EXCHANGER
+  exchangerTempReport.reset();
+#endif
+#ifdef HAS_WATER_REFILL
+  waterLevelReport.reset();
+#endif
+#ifdef USE_TELEMETRY_FRAME
+  relayReport.reset();
+#  ifdef HAS_WATER_REFILL
+  valveReport.reset();
+#  endif
+#endif
+}
+
+// One round of mqtt_update_values(), with all readings due
+BENCH(mqtt_update_values) {
+  if (!_connect()) {
+    bench::note("mqtt_update_values: broker not connected");
+    return;
+  }
+  status_t saved = controlStatus;
+  controlStatus.hasReadings = true;
+  NativeHAL::onPublish = _countPublish;
+  _published = 0;
+  for (uint64_t i = 0;  i < n;  i++) {
+    controlStatus.mainTemperature = _temperature(i);
+#ifdef HAS_HEAT_EXCHANGER
+    controlStatus.exchangerTemperature = _temperature(i + 7);
+#endif
+    _resetReports();
+    mqtt_update_values();
+  }
+  NativeHAL::onPublish = NULL;
+  if (_published < n)
+    bench::note("mqtt_update_values: only %llu publishes", (unsigned long long)_published);
+  controlStatus = saved;
+  _disconnect();
+}
+
+// Draw into the framebuffer and flush changed tiles to the (mock) display
+BENCH(display_update) {
+  status_t saved = controlStatus;
+  for (uint64_t i = 0;  i < n;  i++) {
+    controlStatus.mainTemperature = _temperature(i);
+    controlStatus.relayOn = i & 1;
+    display_update();
+    bench::keep(screen.flush(u8x8));
+  }
+  controlStatus = saved;
+}
@@ -0,0 +1,116 @@
+// Closed-loop run of the firmware (setup()/loop() from src/main.cpp, built
+// in via bench_mqtt.cpp) against the simulated pool in PoolPlant.h, for
+// weeks of virtual time.  Reports heater energy, time to setpoint, relay
+// and valve wear, and how closely the (true) pool temperature tracks the
+// setpoint; to compare controller configurations, change config.h or the
+// constants in main.cpp and below, and rerun ("program plant").
+//
+// Firmware state is static, so there is a single run per process.
+
+#include <Arduino.h>
+#include "config.h"
+
+#include <WiFi.h>
+#include <NativeHAL.h>
+
+#include "bench.h"
+#include "PoolPlant.h"
+
+#include <time.h>
+
+extern void setup();
+extern void loop();
+
+static const double PLANT_DAYS = 14;
+static const double PLANT_START_F = 70.0;
+static const float PLANT_SETPOINT_F = 87.0;
+static const uint64_t PLANT_TICK_US = 1000;  // Virtual time per loop() pass, as in the native driver
+static const double RELAY_RATED_CYCLES = 100000;  // Typical electrical life, at rated load
+
+// Wiring and thermistor circuit, as in src/main.cpp (where they are static)
+static const PoolPlantWiring PLANT_WIRING = {
+  4, 2,  // RELAY_PIN, VALVE_PIN
+#ifdef USE_ADS1115
+  2, 0,  // MAIN_THERMISTOR_CHANNEL, EXCHANGER_THERMISTOR_CHANNEL
+  true, 32767, 32767,
+#else
+  34, 35,  // MAIN_THERMISTOR_PIN, EXCHANGER_THERMISTOR_PIN
+  false, 4095 / 0.60351, 4095,  // ADC_ATTENUATION_FACTOR
+#endif
+  18, 19,  // WATERLEVEL_HI_PIN, WATERLEVEL_MID_PIN
+  10000.0, 10000.0, 25.0, 3950.0,
+};
+
+static inline double _celsius(double f) { return (f - 32) / 1.8; }
+static inline double _fahrenheit(double c) { return c * 1.8 + 32; }
+
+BENCH_ONCE(plant) {
+  PoolPlantParams params;
+  PoolPlant plant(params, PLANT_WIRING, _celsius(PLANT_START_F));
+  plant.step();
+
+  char setpoint[16];
+  snprintf(setpoint, sizeof(setpoint), "%.1f", PLANT_SETPOINT_F);
+  NativeHAL::injectMessage(MQTT_REALM "/main/setpoint", setpoint);
+  NativeHAL::injectMessage(MQTT_REALM "/heater/control", "auto");
+#ifdef HAS_WATER_REFILL
+  NativeHAL::injectMessage(MQTT_REALM "/refill/control", "auto");
+#endif
+
+  struct timespec wallStart, wallEnd;
+  clock_gettime(CLOCK_MONOTONIC, &wallStart);
+
+  setup();
+  uint64_t start = NativeHAL::now();
+  uint64_t end = start + (uint64_t)(PLANT_DAYS * 86400e6);
+  uint64_t reached = 0;  // When first at setpoint
+  double sumError = 0, sumSqError = 0, weight = 0;
+  double lowF = 1e9, highF = -1e9;
+  unsigned long loops = 0;
+  while (NativeHAL::now() < end) {
+    uint64_t before = NativeHAL::now();
+    plant.step();
+    WiFi.status();  // Raise any pending WiFi events
+    loop();
+    loops++;
+    NativeHAL::advance(PLANT_TICK_US);
+
+    // Tracking, from the first time at setpoint, weighted by time
+    double f = _fahrenheit(plant.poolC());
+    if (!reached && f >= PLANT_SETPOINT_F)
+      reached = before;
+    if (reached) {
+      double dt = (NativeHAL::now() - before) / 1e6;
+      double error = f - PLANT_SETPOINT_F;
+      sumError += error * dt;
+      sumSqError += error * error * dt;
+      weight += dt;
+      lowF = min(lowF, f);
+      highF = max(highF, f);
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &wallEnd);
+  double wallSec = (wallEnd.tv_sec - wallStart.tv_sec) + 1e-9 * (wallEnd.tv_nsec - wallStart.tv_nsec);
+  double days = (NativeHAL::now() - start) / 86400e6;
+
+  bench::note("plant: %.1f m^3, %.1f m^2 (%.0f%% covered), %.0f W heater, air %.0f'C +/- %.0f, setpoint %.1f'F",
+    params.volume, params.area, 100 * params.cover, params.heaterPower, params.airMean, params.airSwing,
+    PLANT_SETPOINT_F);
+  bench::note("plant: %.1f days in %.2f sec (%.0fx real time), %lu loops",
+    days, wallSec, days * 86400 / wallSec, loops);
+  bench::note("plant: heater %.1f kWh, on %.1f h (%.1f%%)",
+    plant.heaterJoules / 3.6e6, plant.heaterSec / 3600, 100 * plant.heaterSec / (days * 86400));
+  if (reached)
+    bench::note("plant: time to setpoint %.2f h, from %.1f'F", (reached - start) / 3600e6, PLANT_START_F);
+  else
+    bench::note("plant: setpoint never reached, from %.1f'F", PLANT_START_F);
+  bench::note("plant: relay %lu cycles (%.1f/day; %.1f years to %.0fk rated)",
+    plant.relayCycles, plant.relayCycles / days,
+    plant.relayCycles ? RELAY_RATED_CYCLES / (plant.relayCycles / days) / 365 : 0.0, RELAY_RATED_CYCLES / 1000);
+  if (weight > 0)
+    bench::note("plant: after setpoint, error mean %+.3f, rms %.3f 'F, range %.2f..%.2f'F",
+      sumError / weight, sqrt(sumSqError / weight), lowF, highF);
+  bench::note("plant: valve %lu cycles, refill %.0f l, evaporation %.0f l",
+    plant.valveCycles, plant.refillKg, plant.evaporatedKg);
+}
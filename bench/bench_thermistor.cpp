@@ -0,0 +1,158 @@
+#include <Arduino.h>
+#include <Thermistor.h>
+#include <ThermistorTable.h>
+
+#include <cmath>
+
+#include "bench.h"
+
+// Same sensor parameters as main.cpp
+static const double REF_R = 10000.0, NOM_R = 10000.0, NOM_T = 25.0, BETA = 3950.0;
+
+// Ratio sweep over ~50..110'F, so table lookups do not all hit one segment
+static const double X_LO = 0.317, X_HI = 0.669;
+static const unsigned N_SWEEP = 1024;
+
+template <typename T>
+static inline T _sweep(unsigned i) {
+  return T(X_LO + (X_HI - X_LO) * (i % N_SWEEP) / N_SWEEP);
+}
+
+// Port that "acquires" the next value of the sweep, one sample per reading
+template <typename T>
+class SweepPort : public BasicADCPort<T> {
+public:
+  SweepPort() : BasicADCPort<T>(T(1), 1, 0), _i(0) { }
+  virtual T acquire() override { return _sweep<T>(++_i); }
+  inline T current() const { return _sweep<T>(_i); }
+private:
+  unsigned _i;
+};
+
+// As in BasicThermistor::available(), plus fahrenheit()
+template <typename T>
+static inline T _formulaF(T x) {
+  using std::log;
+  static const T invNomT = T(1.0/(NOM_T + 273.15));
+  static const T logConst = T(log(REF_R/NOM_R)/BETA);
+  static const T beta = T(BETA);
+  T tempK = T(1)/(invNomT + logConst - log(T(1)/x - T(1))/beta);
+  return T(32) + T(1.8) * (tempK - T(273.15));
+}
+
+/***************************************************************************
+ * Conversion kernel alone
+ ***************************************************************************/
+
+BENCH(convert_formula_double) {
+  for (uint64_t i = 0;  i < n;  i++)
+    bench::keep(_formulaF(_sweep<double>(i)));
+}
+
+BENCH(convert_formula_float) {
+  for (uint64_t i = 0;  i < n;  i++)
+    bench::keep(_formulaF(_sweep<float>(i)));
+}
+
+template <typename T>
+static inline void _convertTable(uint64_t n) {
+  static ThermistorTable<UNIT_FAHRENHEIT, 7, T> table(REF_R, NOM_R, NOM_T, BETA);
+  static T xs[N_SWEEP];  // Precomputed, as T(double) is costly for Fixed
+  static bool init = false;
+  if (!init) {
+    for (unsigned i = 0;  i < N_SWEEP;  i++)
+      xs[i] = _sweep<T>(i);
+    init = true;
+  }
+  for (uint64_t i = 0;  i < n;  i++)
+    bench::keep(table(xs[i % N_SWEEP]));
+}
+
+BENCH(convert_table_double) { _convertTable<double>(n); }
+BENCH(convert_table_float) { _convertTable<float>(n); }
+BENCH(convert_table_q16_16) { _convertTable<q16_16_t>(n); }
+
+/***************************************************************************
+ * Full reading path (port sample, conversion, smoothing)
+ ***************************************************************************/
+
+template <typename T, typename Sensor>
+static inline T _read(SweepPort<T> &port, Sensor &sensor) {
+  port.request();
+  port.sample(0);
+  sensor.available();
+  return sensor.fahrenheit();
+}
+
+BENCH(thermistor_formula_double) {
+  static SweepPort<double> port;
+  static BasicThermistor<double> sensor(port, REF_R, NOM_R, NOM_T, BETA, 0.98);
+  for (uint64_t i = 0;  i < n;  i++)
+    bench::keep(_read(port, sensor));
+}
+
+BENCH(thermistor_formula_float) {
+  static SweepPort<float> port;
+  static BasicThermistor<float> sensor(port, REF_R, NOM_R, NOM_T, BETA, 0.98);
+  for (uint64_t i = 0;  i < n;  i++)
+    bench::keep(_read(port, sensor));
+}
+
+BENCH(thermistor_table_float) {
+  static SweepPort<float> port;
+  static TableThermistor<UNIT_FAHRENHEIT, 7, float> sensor(port, REF_R, NOM_R, NOM_T, BETA, 0.98);
+  for (uint64_t i = 0;  i < n;  i++)
+    bench::keep(_read(port, sensor));
+}
+
+BENCH(thermistor_table_q16_16) {
+  static SweepPort<q16_16_t> port;
+  static TableThermistor<UNIT_FAHRENHEIT, 7, q16_16_t> sensor(port, REF_R, NOM_R, NOM_T, BETA, 0.98);
+  for (uint64_t i = 0;  i < n;  i++)
+    bench::keep(_read(port, sensor));
+}
+
+/***************************************************************************
+ * Accuracy, vs the double formula
+ ***************************************************************************/
+
+// Max abs error over the sweep, of readings from an unsmoothed Sensor
+template <typename T, typename Sensor>
+static double _maxError() {
+  SweepPort<T> port;
+  Sensor sensor(port, REF_R, NOM_R, NOM_T, BETA);
+  double err = 0.0;
+  for (unsigned i = 0;  i < N_SWEEP;  i++) {
+    double tempF = (double)_read(port, sensor);
+    err = max(err, fabs(tempF - _formulaF((double)port.current())));
+  }
+  return err;
+}
+
+BENCH_ONCE(thermistor_error) {
+  bench::note("max error over 50..110'F, formula<float>: %.4f'F",
+    _maxError<float, BasicThermistor<float> >());
+  bench::note("max error over 50..110'F, table<double>: %.4f'F",
+    _maxError<double, TableThermistor<UNIT_FAHRENHEIT, 7, double> >());
+  bench::note("max error over 50..110'F, table<float>: %.4f'F",
+    _maxError<float, TableThermistor<UNIT_FAHRENHEIT, 7, float> >());
+  bench::note("max error over 50..110'F, table<q16_16>: %.4f'F",
+    _maxError<q16_16_t, TableThermistor<UNIT_FAHRENHEIT, 7, q16_16_t> >());
+}
+
+// Max abs error of the table vs the exact formula, by table size
+BENCH_ONCE(thermistor_table_error) {
+  ThermistorTable<UNIT_FAHRENHEIT, 6, double> table6(REF_R, NOM_R, NOM_T, BETA);
+  ThermistorTable<UNIT_FAHRENHEIT, 7, double> table7(REF_R, NOM_R, NOM_T, BETA);
+  ThermistorTable<UNIT_FAHRENHEIT, 8, double> table8(REF_R, NOM_R, NOM_T, BETA);
+  double err6 = 0.0, err7 = 0.0, err8 = 0.0;
+  for (unsigned i = 0;  i <= 100000;  i++) {
+    double x = X_LO + (X_HI - X_LO) * i / 100000;
+    double tempF = _formulaF(x);
+    err6 = max(err6, fabs(table6(x) - tempF));
+    err7 = max(err7, fabs(table7(x) - tempF));
+    err8 = max(err8, fabs(table8(x) - tempF));
+  }
+  bench::note("thermistor table max error over 50..110'F: BITS=6 %.4f'F, BITS=7 %.4f'F, BITS=8 %.4f'F",
+    err6, err7, err8);
+}
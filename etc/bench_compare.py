@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+
+"""Compare two runs of the host micro-benchmarks
+
+Reads the JSON lines written by `program -j` (env:native_bench), e.g.
+
+  .pio/build/native_bench/program -j > before.json
+  (make a change, rebuild)
+  .pio/build/native_bench/program -j > after.json
+  etc/bench_compare.py before.json after.json
+
+and prints time and allocations per op, side by side.  Exits with status
+1 if any case got slower by more than the threshold, or allocates more
+per op at all (allocation counts are exact, unlike times), so it can gate
+a change.  Notes (accuracy checks, plant results) are not compared.
+
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    results = {}
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line:
+                continue
+            r = json.loads(line)
+            if 'ns_per_op' in r:
+                results[r['name']] = r
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('baseline')
+    parser.add_argument('current')
+    parser.add_argument('-t', '--threshold', type=float, default=10.0,
+                        help='slowdown, in percent, that counts as a regression (default: %(default)s)')
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+
+    regressions = 0
+    print('%-32s %12s %12s %8s %9s %9s' % ('case', 'ns/op', 'was', 'change', 'allocs/op', 'was'))
+    for name, r in current.items():
+        b = baseline.get(name)
+        if b is None:
+            print('%-32s %12.1f %12s %8s %9.2f %9s' % (name, r['ns_per_op'], '-', 'new', r['allocs_per_op'], '-'))
+            continue
+        change = 100.0 * (r['ns_per_op'] / b['ns_per_op'] - 1) if b['ns_per_op'] > 0 else 0.0
+        flag = ''
+        if change > args.threshold or r['allocs_per_op'] > b['allocs_per_op']:
+            flag = '  <-- regression'
+            regressions += 1
+        print('%-32s %12.1f %12.1f %+7.1f%% %9.2f %9.2f%s' % (
+            name, r['ns_per_op'], b['ns_per_op'], change, r['allocs_per_op'], b['allocs_per_op'], flag))
+    for name in baseline:
+        if name not in current:
+            print('%-32s %12s %12.1f %8s' % (name, '-', baseline[name]['ns_per_op'], 'gone'))
+
+    if regressions:
+        print('%d regression(s)' % regressions, file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+
+"""Throughput test for poolbridge.py
+
+Feeds synthetic MQTT messages through poolbridge.on_message() as fast as
+possible, with a local stand-in for the InfluxDB HTTP write endpoint
+(which can add a fixed delay per request, fail some requests, and
+reject batches with bad points), and reports sustained messages/second
+until all points are written, or dropped as rejected.  For
+comparison, also times one synchronous write per message, as the bridge
+used to do.  Only needs the standard library.
+
+"""
+
+import argparse
+import http.server
+import os
+import sys
+import tempfile
+import threading
+import time
+import types
+import urllib.request
+
+# paho is only used by poolbridge.main(); stub it if not installed
+try:
+    import paho.mqtt.client  # noqa: F401
+except ImportError:
+    paho = types.ModuleType('paho')
+    paho.mqtt = types.ModuleType('paho.mqtt')
+    paho.mqtt.client = types.ModuleType('paho.mqtt.client')
+    sys.modules.update({'paho': paho, 'paho.mqtt': paho.mqtt, 'paho.mqtt.client': paho.mqtt.client})
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import poolbridge  # noqa: E402
+
+
+class StandIn(http.server.ThreadingHTTPServer):
+    daemon_threads = True
+
+    def __init__(self, latency, fail_every):
+        super().__init__(('127.0.0.1', 0), StandInHandler)
+        self.latency = latency
+        self.fail_every = fail_every
+        self.lock = threading.Lock()
+        self.requests = 0
+        self.points = 0
+
+
+class StandInHandler(http.server.BaseHTTPRequestHandler):
+    def do_POST(self):
+        body = self.rfile.read(int(self.headers['Content-Length']))
+        server = self.server
+        time.sleep(server.latency)
+        with server.lock:
+            server.requests += 1
+            fail = server.fail_every and server.requests % server.fail_every == 0
+            # As InfluxDB, any unparseable point fails the whole batch
+            reject = not fail and b'value=nan' in body
+            if not fail and not reject:
+                server.points += body.count(b'\n')
+        self.send_response(503 if fail else 400 if reject else 204)
+        self.end_headers()
+
+    def log_message(self, *args):
+        pass
+
+
+class Message:
+    def __init__(self, topic, payload):
+        self.topic = topic
+        self.payload = payload
+
+
+# With reject_every, every so often a reading InfluxDB cannot take
+def _messages(n, reject_every=0):
+    for i in range(n):
+        if reject_every and i % reject_every == reject_every - 1:
+            yield Message('pool/main/temperature', b'nan@%d' % (1596240000 + i))
+        else:
+            yield Message('pool/main/temperature', b'%.2f@%d' % (80 + (i % 1000) / 100, 1596240000 + i))
+
+
+def _feed(n, reject_every=0):
+    with open(os.devnull, 'w') as devnull:
+        stdout, sys.stdout = sys.stdout, devnull  # on_message() prints every message
+        try:
+            for msg in _messages(n, reject_every):
+                poolbridge.on_message(None, None, msg)
+        finally:
+            sys.stdout = stdout
+
+
+def run_batched(server, n, batch_size, spool_path, retries, reject_every=0):
+    poolbridge.writer = poolbridge.BatchWriter(
+        '127.0.0.1', server.server_address[1], batch_size=batch_size,
+        spool_path=spool_path, retries=retries, retry_delay=0.05).start()
+    start = time.monotonic()
+    _feed(n, reject_every)
+    fed = time.monotonic() - start
+    poolbridge.writer.close()
+    elapsed = time.monotonic() - start
+    w = poolbridge.writer
+    print('batched:  %8d msgs  %8.0f msgs/s  (on_message %.0f msgs/s)  %d requests  '
+          'written %d, spooled %d, dropped %d' %
+          (n, n / elapsed, n / fed, w.requests, w.written, w.spooled, w.dropped))
+    return w
+
+
+def run_sync(server, n):
+    # Old behaviour: one blocking write request per message, on the MQTT thread
+    # (failed writes were simply lost, so they are only counted)
+    writer = poolbridge.BatchWriter('127.0.0.1', server.server_address[1], retries=0)
+    failed = 0
+
+    def put(*data):
+        nonlocal failed
+        try:
+            writer._post([poolbridge.to_line(d) for d in data])
+        except OSError:  # Includes HTTPError
+            failed += 1
+
+    poolbridge.writer = types.SimpleNamespace(put=put)
+    start = time.monotonic()
+    _feed(n)
+    elapsed = time.monotonic() - start
+    print('sync:     %8d msgs  %8.0f msgs/s  %d requests, %d failed' % (n, n / elapsed, writer.requests, failed))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('-n', '--messages', type=int, default=100000)
+    parser.add_argument('-l', '--latency', type=float, default=20, help='stand-in delay per request (ms)')
+    parser.add_argument('-b', '--batch-size', type=int, default=poolbridge.BATCH_SIZE)
+    parser.add_argument('-f', '--fail-every', type=int, default=0, help='fail every Nth request with 503')
+    parser.add_argument('--retries', type=int, default=poolbridge.WRITE_RETRIES,
+                        help='per batch, before spooling it (default: %(default)s)')
+    parser.add_argument('-r', '--reject-every', type=int, default=0,
+                        help='make every Nth message a point InfluxDB rejects (with 400, along with its batch)')
+    parser.add_argument('--sync-messages', type=int, default=200, help='messages for the synchronous baseline')
+    args = parser.parse_args()
+
+    server = StandIn(args.latency / 1000, args.fail_every)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+
+    with tempfile.TemporaryDirectory() as tmp:
+        spool_path = os.path.join(tmp, 'spool')
+        if args.sync_messages:
+            run_sync(server, args.sync_messages)
+            server.points = 0
+        w = run_batched(server, args.messages, args.batch_size, spool_path, args.retries, args.reject_every)
+        # Once the server is healthy, the spool must drain completely (bad
+        # points in it included), as on the next successful write
+        server.fail_every = 0
+        w._replay_spool()
+        left = sum(1 for _ in open(spool_path)) if os.path.exists(spool_path) else 0
+        print('stand-in received %d points, %d left in spool' % (server.points, left))
+        if server.points != w.written or w.written + w.dropped != args.messages:
+            print('MISSING %d points' % (args.messages - w.written - w.dropped))
+            return 1
+        if left:
+            print('STUCK IN SPOOL %d points' % left)
+            return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+
+"""Fetch on-device history from the pool controller
+
+Publishes a query on 'pool/history/query' (USE_HISTORY in the firmware),
+collects the reply frames from 'pool/history/data', and prints one CSV
+row per bucket, e.g. to backfill a gap in the database after an outage:
+
+  etc/pool_history.py h --since 6h > gap.csv
+
+Buckets are per minute (last 2 hours), hour (last 3 days) or day (last
+2 months, from UTC midnight); only closed buckets are returned.
+
+"""
+
+import argparse
+import csv
+import os
+import sys
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import poolbridge  # noqa: E402
+
+UNITS = {'m': 60, 'h': 3600, 'd': 86400}
+
+
+def parse_since(s):
+    """'<n>[m|h|d]' ago, or UTC seconds"""
+    if s[-1] in UNITS:
+        return int(time.time() - float(s[:-1]) * UNITS[s[-1]])
+    return int(s)
+
+
+def fetch(address, resolution, start, end, timeout):
+    records = []
+    done = threading.Event()
+    error = []
+
+    def on_connect(client, userdata, flags, rc):
+        client.subscribe(poolbridge.HISTORY_DATA_TOPIC)
+        query = '%s %d' % (resolution, start) + (' %d' % end if end is not None else '')
+        client.publish(poolbridge.HISTORY_QUERY_TOPIC, query)
+
+    def on_message(client, userdata, msg):
+        try:
+            res, last, recs = poolbridge.decode_history(msg.payload)
+        except ValueError as e:
+            error.append(str(e))
+            done.set()
+            return
+        if res != resolution:
+            return  # Reply to someone else's query
+        records.extend(recs)
+        if last:
+            done.set()
+
+    client = mqtt.Client()
+    client.on_connect = on_connect
+    client.on_message = on_message
+    client.connect(address, 1883)
+    client.loop_start()
+    try:
+        if not done.wait(timeout):
+            raise SystemExit('no complete reply within %gs' % timeout)
+    finally:
+        client.loop_stop()
+        client.disconnect()
+    if error:
+        raise SystemExit('invalid frame: %s' % error[0])
+    return records
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('resolution', choices=sorted(UNITS))
+    parser.add_argument('--since', default='0', help="start, as '<n>[m|h|d]' ago or UTC seconds (default: all)")
+    parser.add_argument('--until', help='end, as UTC seconds (default: latest)')
+    parser.add_argument('--mqtt', default=poolbridge.MQTT_ADDRESS, help='broker address (default: %(default)s)')
+    parser.add_argument('--timeout', type=float, default=30.0, help='seconds (default: %(default)s)')
+    args = parser.parse_args()
+
+    records = fetch(args.mqtt, args.resolution, parse_since(args.since),
+                    int(args.until) if args.until else None, args.timeout)
+
+    out = csv.writer(sys.stdout)
+    out.writerow(['start', 'main_min', 'main_mean', 'main_max', 'exchanger_min', 'exchanger_mean', 'exchanger_max',
+                  'level_min', 'level_mean', 'level_max', 'relay_duty', 'valve_duty'])
+    for r in records:
+        out.writerow([r.start, *(r.main or ('',) * 3), *(r.exchanger or ('',) * 3), *(r.level or ('',) * 3),
+                      '%.3f' % r.relay_duty, '%.3f' % r.valve_duty])
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -8,31 +8,48 @@ This script receives MQTT data and saves those to InfluxDB.
 
 """
 
+import os
+import queue
 import re
-from typing import NamedTuple
+import struct
+import threading
+import time
+import urllib.error
+import urllib.parse
+import urllib.request
+from typing import List, NamedTuple, Optional
 
 import paho.mqtt.client as mqtt
-from influxdb import InfluxDBClient
 
 INFLUXDB_ADDRESS = 'localhost'
+INFLUXDB_PORT = 8086
 INFLUXDB_USER = 'pool'
 INFLUXDB_PASSWORD = '<secret>'
 INFLUXDB_DATABASE = 'pool_db'
 
+# Points are queued by on_message() and written by a worker thread, so a
+# slow InfluxDB never stalls the MQTT network loop.  A batch is written
+# once it has BATCH_SIZE points, or BATCH_INTERVAL seconds after its first
+# point; failed batches are retried, then spooled to disk, and replayed
+# after the next successful write.
+BATCH_SIZE = 500
+BATCH_INTERVAL = 1.0  # seconds
+QUEUE_SIZE = 100000  # points; beyond that, new points are dropped
+WRITE_TIMEOUT = 10.0  # seconds, per HTTP request
+WRITE_RETRIES = 3
+WRITE_RETRY_DELAY = 1.0  # seconds, doubling after each retry
+SPOOL_PATH = os.path.expanduser('~/.cache/poolbridge.spool')  # Not /tmp: PrivateTmp in poolbridge.service
+
 MQTT_ADDRESS = 'localhost'
-MQTT_TOPICS = ['pool/main/+', 'pool/exchanger/+']
+MQTT_TOPICS = ['pool/main/+', 'pool/exchanger/+', 'pool/relay/state', 'pool/valve/state', 'pool/waterlevel',
+               'pool/telemetry']
 MQTT_CLIENT_ID = 'MQTTPoolBridge'
 
-influxdb_client = InfluxDBClient(
-    INFLUXDB_ADDRESS, 8086,
-    INFLUXDB_USER, INFLUXDB_PASSWORD, INFLUXDB_DATABASE
-)
-
-
 class TemperatureData(NamedTuple):
     measurement: str
     tag: str
     value: float
+    timestamp: Optional[int]  # UTC seconds, for readings held back while offline
 
 
 def on_connect(client, userdata, flags, rc):
@@ -43,48 +60,298 @@ def on_connect(client, userdata, flags, rc):
         client.subscribe(topic)
 
 
-# Topics are 'pool/{main,exchanger}/{temperature,setpoint}'
-MQTT_REGEX = re.compile('pool/(?P<component>[^/]+)/(?P<subtype>[^/]+)')
+# Topics are 'pool/{main,exchanger}/{temperature,setpoint}', 'pool/{relay,valve}/state'
+# and 'pool/waterlevel' (tagged 'level', as in telemetry frames)
+MQTT_REGEX = re.compile('pool/(?P<component>[^/]+)(?:/(?P<subtype>[^/]+))?$')
+
+# Payload is '<value>' or, if it was queued while disconnected, '<value>@<utc_seconds>'
+PAYLOAD_REGEX = re.compile(r'(?P<value>[^@]+)(?:@(?P<timestamp>\d+))?$')
+
+# Switch states and water levels are recorded as numbers, with the same
+# values as in telemetry frames
+STATE_VALUES = {'off': 0.0, 'on': 1.0, 'lo': 0.0, 'mid': 1.0, 'hi': 2.0, 'invalid': 3.0}
+
+
+def _value(s):
+    """Reading, switch state or water level, as a float; raises ValueError if none of those"""
+    if s in STATE_VALUES:
+        return STATE_VALUES[s]
+    return float(s)
+
+# Binary frames on 'pool/telemetry' (USE_TELEMETRY_FRAME in the firmware);
+# layout must match include/TelemetryFrame.h
+TELEMETRY_TOPIC = 'pool/telemetry'
+TELEMETRY_MAGIC = ord('P')
+TELEMETRY_VERSION = 1
+TELEMETRY_HEADER = struct.Struct('<BBBB')  # magic, version, channel mask, record count
+TELEMETRY_RECORD = struct.Struct('<IhhBB')  # utc, main/exchanger centi-'F, level, switches
+
+# Channel mask bit -> (measurement, tag, value from record fields)
+TELEMETRY_CHANNELS = [
+    (0x01, 'main', 'temperature', lambda r: r[1] / 100.0),
+    (0x02, 'exchanger', 'temperature', lambda r: r[2] / 100.0),
+    (0x04, 'waterlevel', 'level', lambda r: float(r[3])),
+    (0x08, 'relay', 'state', lambda r: float(r[4] & 0x01)),
+    (0x10, 'valve', 'state', lambda r: float((r[4] >> 1) & 0x01)),
+]
+
+
+def decode_telemetry(frame):
+    """Returns list of TemperatureData, one per channel and record; raises ValueError if malformed."""
+    if len(frame) < TELEMETRY_HEADER.size:
+        raise ValueError('short frame')
+    magic, version, mask, count = TELEMETRY_HEADER.unpack_from(frame)
+    if magic != TELEMETRY_MAGIC or version != TELEMETRY_VERSION:
+        raise ValueError('unknown frame type/version %d/%d' % (magic, version))
+    if len(frame) != TELEMETRY_HEADER.size + count * TELEMETRY_RECORD.size:
+        raise ValueError('bad frame length %d for %d records' % (len(frame), count))
+    data = []
+    for r in TELEMETRY_RECORD.iter_unpack(frame[TELEMETRY_HEADER.size:]):
+        timestamp = r[0] or None  # All channels share the record's timestamp
+        for bit, measurement, tag, value in TELEMETRY_CHANNELS:
+            if mask & bit:
+                data.append(TemperatureData(measurement, tag, value(r), timestamp))
+    return data
+
+
+# Binary frames on 'pool/history/data', in reply to a query on
+# 'pool/history/query' (USE_HISTORY in the firmware; see pool_history.py);
+# layout must match include/History.h
+HISTORY_QUERY_TOPIC = 'pool/history/query'
+HISTORY_DATA_TOPIC = 'pool/history/data'
+HISTORY_MAGIC = ord('H')
+HISTORY_VERSION = 1
+HISTORY_FLAG_LAST = 0x01
+HISTORY_HEADER = struct.Struct('<BBcBB')  # magic, version, resolution, flags, record count
+HISTORY_RECORD = struct.Struct('<I3h3h3BBB')  # start, main/exchanger min/mean/max, level min/mean/max, duties
+HISTORY_NONE = -0x8000
+HISTORY_LEVEL_NONE = 0xff
+
+
+class HistoryRecord(NamedTuple):
+    start: int  # UTC seconds
+    main: Optional[tuple]  # min, mean, max 'F; None if no readings
+    exchanger: Optional[tuple]
+    level: Optional[tuple]  # min, mean, max (0 lo, 1 mid, 2 hi)
+    relay_duty: float  # 0..1
+    valve_duty: float
+
+
+def decode_history(frame):
+    """Returns (resolution, last, list of HistoryRecord); raises ValueError if malformed."""
+    if len(frame) < HISTORY_HEADER.size:
+        raise ValueError('short frame')
+    magic, version, resolution, flags, count = HISTORY_HEADER.unpack_from(frame)
+    if magic != HISTORY_MAGIC or version != HISTORY_VERSION:
+        raise ValueError('unknown frame type/version %d/%d' % (magic, version))
+    if len(frame) != HISTORY_HEADER.size + count * HISTORY_RECORD.size:
+        raise ValueError('bad frame length %d for %d records' % (len(frame), count))
+    records = []
+    for r in HISTORY_RECORD.iter_unpack(frame[HISTORY_HEADER.size:]):
+        main = None if r[1] == HISTORY_NONE else tuple(v / 100.0 for v in r[1:4])
+        exchanger = None if r[4] == HISTORY_NONE else tuple(v / 100.0 for v in r[4:7])
+        level = None if r[7] == HISTORY_LEVEL_NONE else (float(r[7]), r[8] / 100.0, float(r[9]))
+        records.append(HistoryRecord(r[0], main, exchanger, level, r[10] / 200.0, r[11] / 200.0))
+    return resolution.decode('ascii'), bool(flags & HISTORY_FLAG_LAST), records
+
 
 def on_message(client, userdata, msg):
     """The callback for when a PUBLISH message is received from the server."""
+    if msg.topic == TELEMETRY_TOPIC:
+        try:
+            data = decode_telemetry(msg.payload)
+        except ValueError as e:
+            print('MQTT', msg.topic, 'invalid frame:', e)
+            return
+        print('MQTT', msg.topic, '->', len(data), 'values')
+        _send_sensor_data_to_influxdb(*data)
+        return
     payload = msg.payload.decode('utf-8')
     print('MQTT', msg.topic, '->', payload)
     m = MQTT_REGEX.match(msg.topic)
     #print("DBG:", m)
-    if m:
+    p = PAYLOAD_REGEX.match(payload)
+    if m and p:
+        try:
+            value = _value(p['value'])
+        except ValueError:
+            print('MQTT', msg.topic, 'invalid payload')
+            return
         data = TemperatureData(
             m['component'],
-            m['subtype'],
-            float(payload)
+            m['subtype'] or 'level',
+            value,
+            int(p['timestamp']) if p['timestamp'] else None
         )
         _send_sensor_data_to_influxdb(data)
 
 
-def _send_sensor_data_to_influxdb(data):
-    json_body = [
-        {
-            'measurement': data.measurement,
-            'tags': {
-                'tag': data.tag,
-            },
-            'fields': {
-                'value': data.value
-            }
-        }
-    ]
-    #print("DBG:", json_body)
-    influxdb_client.write_points(json_body)
+def _escape(s):
+    """Line protocol escaping, for measurement names and tag values"""
+    return s.replace('\\', '\\\\').replace(',', '\\,').replace(' ', '\\ ').replace('=', '\\=')
+
+
+def to_line(data, now=None):
+    """Line protocol, with second precision; points without a timestamp
+    get the current time, so they keep it if spooled"""
+    timestamp = data.timestamp if data.timestamp is not None else int(now or time.time())
+    return '%s,tag=%s value=%r %d' % (_escape(data.measurement), _escape(data.tag), float(data.value), timestamp)
+
+
+class BatchWriter:
+    """Writes line protocol points to InfluxDB (1.x HTTP API), in batches, from a worker thread"""
+
+    def __init__(self, address=INFLUXDB_ADDRESS, port=INFLUXDB_PORT, database=INFLUXDB_DATABASE,
+                 user=INFLUXDB_USER, password=INFLUXDB_PASSWORD,
+                 batch_size=BATCH_SIZE, batch_interval=BATCH_INTERVAL, spool_path=SPOOL_PATH,
+                 retries=WRITE_RETRIES, retry_delay=WRITE_RETRY_DELAY):
+        params = {'db': database, 'precision': 's'}
+        if user:
+            params.update(u=user, p=password)
+        self.url = 'http://%s:%d/write?%s' % (address, port, urllib.parse.urlencode(params))
+        self.batch_size = batch_size
+        self.batch_interval = batch_interval
+        self.spool_path = spool_path
+        self.retries = retries
+        self.retry_delay = retry_delay
+        self.written = self.spooled = self.dropped = self.requests = 0
+        self._queue = queue.Queue(QUEUE_SIZE)
+        self._thread = threading.Thread(target=self._run, name='influxdb-writer', daemon=True)
+
+    def start(self):
+        self._thread.start()
+        return self
+
+    def put(self, *data):
+        """Queue points; never blocks"""
+        now = time.time()
+        for d in data:
+            try:
+                self._queue.put_nowait(to_line(d, now))
+            except queue.Full:
+                self.dropped += 1
+
+    def close(self, timeout=None):
+        """Write everything queued so far, and stop"""
+        self._queue.put(None)
+        self._thread.join(timeout)
+
+    def _run(self):
+        while True:
+            line = self._queue.get()
+            if line is None:
+                return
+            batch = [line]
+            deadline = time.monotonic() + self.batch_interval
+            stop = False
+            while len(batch) < self.batch_size:
+                try:
+                    line = self._queue.get(timeout=max(0, deadline - time.monotonic()))
+                except queue.Empty:
+                    break
+                if line is None:
+                    stop = True
+                    break
+                batch.append(line)
+            self._write(batch)
+            if stop:
+                return
+
+    def _post(self, lines: List[str]):
+        body = ('\n'.join(lines) + '\n').encode('utf-8')
+        request = urllib.request.Request(self.url, data=body, method='POST')
+        self.requests += 1
+        with urllib.request.urlopen(request, timeout=WRITE_TIMEOUT) as response:
+            response.read()
+
+    def _write(self, lines):
+        delay = self.retry_delay
+        for attempt in range(self.retries + 1):
+            try:
+                self._post(lines)
+            except urllib.error.HTTPError as e:
+                if 400 <= e.code < 500:
+                    # Bad points; retrying or spooling would not help
+                    print('InfluxDB rejected batch of', len(lines), 'points:', e.code, e.read()[:200])
+                    self.dropped += len(lines)
+                    return
+                error = e
+            except OSError as e:
+                error = e
+            else:
+                self.written += len(lines)
+                self._replay_spool()
+                return
+            if attempt < self.retries:
+                time.sleep(delay)
+                delay *= 2
+        print('InfluxDB write failed (%s), spooling %d points' % (error, len(lines)))
+        self._spool(lines)
+
+    def _spool(self, lines):
+        try:
+            os.makedirs(os.path.dirname(self.spool_path), exist_ok=True)
+            with open(self.spool_path, 'a') as f:
+                f.write('\n'.join(lines) + '\n')
+            self.spooled += len(lines)
+        except OSError as e:
+            print('Spool failed (%s), dropping %d points' % (e, len(lines)))
+            self.dropped += len(lines)
+
+    def _replay_spool(self):
+        if not os.path.exists(self.spool_path):
+            return
+        with open(self.spool_path) as f:
+            lines = [l for l in f.read().split('\n') if l]
+        # Spool is only appended to from this thread, so no race here
+        replayed = 0
+        for i in range(0, len(lines), self.batch_size):
+            batch = lines[i:i + self.batch_size]
+            try:
+                self._post(batch)
+            except urllib.error.HTTPError as e:
+                if 400 <= e.code < 500:
+                    # As in _write(): bad points, so skip past them
+                    print('InfluxDB rejected spooled batch of', len(batch), 'points:', e.code, e.read()[:200])
+                    self.dropped += len(batch)
+                    continue
+                error = e
+            except OSError as e:
+                error = e
+            else:
+                self.written += len(batch)
+                replayed += len(batch)
+                continue
+            # Keep what is left, for next time
+            print('Spool replay failed (%s), keeping %d points' % (error, len(lines) - i))
+            with open(self.spool_path, 'w') as f:
+                f.write('\n'.join(lines[i:]) + '\n')
+            return
+        os.remove(self.spool_path)
+        print('Replayed %d spooled points' % replayed)
+
+writer: Optional[BatchWriter] = None
+
+
+def _send_sensor_data_to_influxdb(*data):
+    """Queue points, for the writer thread"""
+    writer.put(*data)
 
 
 def main():
+    global writer
+    writer = BatchWriter().start()
+
     mqtt_client = mqtt.Client(MQTT_CLIENT_ID)
     #mqtt_client.username_pw_set(MQTT_USER, MQTT_PASSWORD)
     mqtt_client.on_connect = on_connect
     mqtt_client.on_message = on_message
 
     mqtt_client.connect(MQTT_ADDRESS, 1883)
-    mqtt_client.loop_forever()
+    try:
+        mqtt_client.loop_forever()
+    finally:
+        writer.close(WRITE_TIMEOUT)
 
 
 if __name__ == '__main__':
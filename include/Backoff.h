@@ -0,0 +1,26 @@
+#ifndef __BACKOFF_H__
+#define __BACKOFF_H__
+
+// Exponential backoff for reconnection attempts, with "equal jitter":
+// after each failure, the next attempt should wait between half and all
+// of the current backoff, which then doubles (up to maxMs)
+class Backoff {
+public:
+  Backoff(uint32_t minMs, uint32_t maxMs)
+  : _min(minMs), _max(maxMs), _current(minMs) { }
+
+  inline void reset() { _current = _min; }
+
+  // After a failure; returns wait (msec) to schedule the next attempt with
+  uint32_t fail() {
+    uint32_t wait = _current/2 + random(_current/2 + 1);
+    _current = (_current < _max/2) ? 2*_current : _max;
+    return wait;
+  }
+
+private:
+  uint32_t _min, _max;
+  uint32_t _current;
+};
+
+#endif /* __BACKOFF_H__ */
@@ -0,0 +1,47 @@
+#ifndef __DEBOUNCER_H__
+#define __DEBOUNCER_H__
+
+// Debounced value of a noisy input (e.g., a switch, or a state derived
+// from several).  Raw values are fed in as they change, with their time;
+// the stable value follows once a new raw value has held, unchanged, for
+// the hold time, which the caller picks per value (e.g., longer for
+// values that should be rare).  Times are millis().
+template <typename T>
+class Debouncer {
+public:
+  Debouncer(T initial) : _stable(initial), _candidate(initial), _since(0) { }
+
+  // Raw value at time at; restarts the hold time if it differs from the
+  // previous raw value
+  void input(T value, unsigned long at) {
+    if (value != _candidate) {
+      _candidate = value;
+      _since = at;
+    }
+  }
+
+  // Returns true if the stable value changed
+  bool settle(unsigned long now, uint32_t holdMs) {
+    if (_candidate == _stable || now - _since < holdMs)
+      return false;
+    _stable = _candidate;
+    return true;
+  }
+
+  // Raw value differs from stable, and has since time since()
+  inline bool pending() const { return _candidate != _stable; }
+  inline unsigned long since() const { return _since; }
+
+  inline T candidate() const { return _candidate; }
+  inline T stable() const { return _stable; }
+
+  // Set stable value right away (e.g., initial reading)
+  inline void reset(T value) { _stable = _candidate = value; }
+
+private:
+  T _stable;
+  T _candidate;
+  unsigned long _since;
+};
+
+#endif /* __DEBOUNCER_H__ */
@@ -0,0 +1,307 @@
+#ifndef __HISTORY_H__
+#define __HISTORY_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+// On-device history, in fixed memory: per-minute, per-hour and per-day
+// rollups (min, mean and max of each temperature and of the water level,
+// and relay and valve duty cycles), each resolution in its own ring of
+// the latest buckets.  Every sample goes into the open bucket of all
+// three resolutions, in O(1); a bucket is closed into its ring once a
+// sample falls into the next one.  Buckets are aligned to UTC, so days
+// run from UTC midnight.
+//
+// A range of closed buckets is dumped as binary frames, laid out like
+// the telemetry frames (see TelemetryFrame.h); etc/poolbridge.py has
+// the matching decoder.  Bump the version on any layout change.
+//
+//   Header (5 bytes):  'H', version, resolution ('m', 'h' or 'd'),
+//                      flags (bit 0: last frame of the reply), record count
+//   Record (21 bytes): uint32 start (UTC),
+//                      int16 main min, mean, max (centi-'F),
+//                      int16 exchanger min, mean, max (centi-'F),
+//                      uint8 water level min, mean (centi-level), max,
+//                      uint8 relay and valve duty (half-percent, 0..200)
+//
+// Channels with no samples in a bucket (e.g., no exchanger, or only
+// invalid water levels) have all fields at HISTORY_NONE (INT16_MIN, or
+// 0xff for the level).
+static const uint8_t HISTORY_FRAME_MAGIC = 'H';
+static const uint8_t HISTORY_FRAME_VERSION = 1;
+static const uint8_t HISTORY_HEADER_SIZE = 5;
+static const uint8_t HISTORY_RECORD_SIZE = 21;
+static const uint8_t HISTORY_FLAG_LAST = 0x01;
+static const int16_t HISTORY_NONE = INT16_MIN;
+static const uint8_t HISTORY_LEVEL_NONE = 0xff;
+
+typedef enum : uint8_t { HISTORY_MINUTE, HISTORY_HOUR, HISTORY_DAY, NUM_HISTORY_RESOLUTIONS } history_resolution_t;
+
+static const char HISTORY_RESOLUTION_CODES[NUM_HISTORY_RESOLUTIONS] = { 'm', 'h', 'd' };
+static const uint32_t HISTORY_PERIODS[NUM_HISTORY_RESOLUTIONS] = { 60, 3600, 86400 };  // Seconds
+
+typedef struct {
+  uint32_t utc;
+  float mainTemperature;
+  float exchangerTemperature;  // NAN if none
+  uint8_t waterLevel;  // Above maxLevel (e.g., LEVEL_INVALID) is not counted
+  bool relayOn;
+  bool valveOn;
+} history_sample_t;
+
+// Closed bucket
+typedef struct {
+  uint32_t start;
+  int16_t main[3], exchanger[3];  // Min, mean, max
+  uint8_t level[3];
+  uint8_t relayDuty, valveDuty;
+} history_record_t;
+
+// Open bucket
+class HistoryRollup {
+public:
+  void reset(uint32_t start) {
+    _start = start;
+    _samples = 0;
+    _main.reset();
+    _exchanger.reset();
+    _levelMin = 0xff;
+    _levelMax = 0;
+    _levelSum = 0;
+    _levelCount = 0;
+    _relayMs = _valveMs = _totalMs = 0;
+  }
+
+  // Switch states are those held over the dtMs before this sample
+  void add(const history_sample_t &s, uint8_t maxLevel, uint32_t dtMs, bool relayOn, bool valveOn) {
+    _samples++;
+    _main.add(s.mainTemperature);
+    _exchanger.add(s.exchangerTemperature);
+    if (s.waterLevel <= maxLevel) {
+      _levelMin = (s.waterLevel < _levelMin) ? s.waterLevel : _levelMin;
+      _levelMax = (s.waterLevel > _levelMax) ? s.waterLevel : _levelMax;
+      _levelSum += s.waterLevel;
+      _levelCount++;
+    }
+    _totalMs += dtMs;
+    _relayMs += relayOn ? dtMs : 0;
+    _valveMs += valveOn ? dtMs : 0;
+  }
+
+  inline uint32_t start() const { return _start; }
+  inline bool empty() const { return _samples == 0; }
+
+  void close(history_record_t &r) const {
+    r.start = _start;
+    _main.close(r.main);
+    _exchanger.close(r.exchanger);
+    if (_levelCount) {
+      r.level[0] = _levelMin;
+      r.level[1] = (uint8_t)((200 * _levelSum / _levelCount + 1) / 2);
+      r.level[2] = _levelMax;
+    } else {
+      r.level[0] = r.level[1] = r.level[2] = HISTORY_LEVEL_NONE;
+    }
+    r.relayDuty = _totalMs ? (uint8_t)((400ULL * _relayMs / _totalMs + 1) / 2) : 0;
+    r.valveDuty = _totalMs ? (uint8_t)((400ULL * _valveMs / _totalMs + 1) / 2) : 0;
+  }
+
+private:
+  struct Stats {
+    float min, max, sum;
+    uint32_t count;
+
+    void reset() {
+      min = INFINITY;
+      max = -INFINITY;
+      sum = 0;
+      count = 0;
+    }
+
+    inline void add(float v) {
+      if (isnan(v))
+        return;
+      min = (v < min) ? v : min;
+      max = (v > max) ? v : max;
+      sum += v;
+      count++;
+    }
+
+    void close(int16_t out[3]) const {
+      if (!count) {
+        out[0] = out[1] = out[2] = HISTORY_NONE;
+        return;
+      }
+      out[0] = _centi(min);
+      out[1] = _centi(sum / count);
+      out[2] = _centi(max);
+    }
+  };
+
+  uint32_t _start;
+  uint32_t _samples;
+  Stats _main, _exchanger;
+  uint8_t _levelMin, _levelMax;
+  uint32_t _levelSum, _levelCount;
+  uint32_t _relayMs, _valveMs, _totalMs;
+
+  static inline int16_t _centi(float value) {
+    float c = roundf(value * 100);
+    return (c > INT16_MAX) ? INT16_MAX : (c <= INT16_MIN) ? INT16_MIN + 1 : (int16_t)c;
+  }
+};
+
+// Latest N closed buckets of one resolution
+template <uint16_t N>
+class HistoryRing {
+public:
+  HistoryRing() : _head(0), _count(0) { }
+
+  void push(const history_record_t &r) {
+    _ring[(_head + _count) % N] = r;
+    if (_count < N)
+      _count++;
+    else
+      _head = (_head + 1) % N;
+  }
+
+  inline uint16_t count() const { return _count; }
+  // Oldest first
+  inline const history_record_t &operator[](uint16_t i) const { return _ring[(_head + i) % N]; }
+
+private:
+  history_record_t _ring[N];
+  uint16_t _head;
+  uint16_t _count;
+};
+
+// M minutes, H hours and D days
+template <uint16_t M, uint16_t H, uint16_t D>
+class History {
+public:
+  static const uint8_t MAX_PER_FRAME = 10;  // Fits PubSubClient's default 256-byte packets
+  static const size_t MAX_FRAME_SIZE = HISTORY_HEADER_SIZE + MAX_PER_FRAME * HISTORY_RECORD_SIZE;
+  static const uint32_t MAX_GAP_MS = 600000;  // Longer gaps (e.g., a reboot) do not count towards duty
+
+  // Water levels above maxLevel are skipped
+  History(uint8_t maxLevel)
+  : _maxLevel(maxLevel), _started(false), _lastMs(0), _lastUtc(0), _relayOn(false), _valveOn(false) { }
+
+  // Samples must have a valid utc; one earlier than the previous sample
+  // (e.g., NTP stepped back) counts as at the same time, so buckets stay
+  // in order.  nowMs is millis(), for duty cycles.
+  void add(const history_sample_t &s, unsigned long nowMs) {
+    uint32_t dtMs = _started ? (uint32_t)(nowMs - _lastMs) : 0;
+    if (dtMs > MAX_GAP_MS)
+      dtMs = 0;
+    uint32_t utc = (_started && s.utc < _lastUtc) ? _lastUtc : s.utc;
+    for (uint8_t res = 0;  res < NUM_HISTORY_RESOLUTIONS;  res++) {
+      HistoryRollup &open = _open[res];
+      uint32_t start = utc - utc % HISTORY_PERIODS[res];
+      if (!_started || open.start() != start) {
+        if (_started && !open.empty()) {
+          history_record_t r;
+          open.close(r);
+          _push(res, r);
+        }
+        open.reset(start);
+      }
+      open.add(s, _maxLevel, dtMs, _relayOn, _valveOn);
+    }
+    _started = true;
+    _lastMs = nowMs;
+    _lastUtc = utc;
+    _relayOn = s.relayOn;
+    _valveOn = s.valveOn;
+  }
+
+  uint16_t count(history_resolution_t res) const {
+    switch (res) {
+      case HISTORY_MINUTE:  return _minutes.count();
+      case HISTORY_HOUR:  return _hours.count();
+      default:  return _days.count();
+    }
+  }
+
+  const history_record_t &record(history_resolution_t res, uint16_t i) const {
+    switch (res) {
+      case HISTORY_MINUTE:  return _minutes[i];
+      case HISTORY_HOUR:  return _hours[i];
+      default:  return _days[i];
+    }
+  }
+
+  // Frame with the next (up to MAX_PER_FRAME) closed buckets starting
+  // in [from, to], into buf (MAX_FRAME_SIZE bytes); advances from past
+  // them, and returns the frame size.  A reply is a series of calls,
+  // until one sets HISTORY_FLAG_LAST (possibly with no records).
+  size_t encode(history_resolution_t res, uint32_t &from, uint32_t to, uint8_t *buf) const {
+    uint16_t n = count(res);
+    uint16_t i = 0;
+    while (i < n && record(res, i).start < from)
+      i++;
+    uint8_t *p = buf + HISTORY_HEADER_SIZE;
+    uint8_t nRecords = 0;
+    for (;  i < n && nRecords < MAX_PER_FRAME;  i++) {
+      const history_record_t &r = record(res, i);
+      if (r.start > to)
+        break;
+      p = _encode(p, r);
+      nRecords++;
+      from = r.start + 1;
+    }
+    bool last = (i >= n || record(res, i).start > to);
+    buf[0] = HISTORY_FRAME_MAGIC;
+    buf[1] = HISTORY_FRAME_VERSION;
+    buf[2] = HISTORY_RESOLUTION_CODES[res];
+    buf[3] = last ? HISTORY_FLAG_LAST : 0;
+    buf[4] = nRecords;
+    return p - buf;
+  }
+
+private:
+  uint8_t _maxLevel;
+  HistoryRollup _open[NUM_HISTORY_RESOLUTIONS];
+  HistoryRing<M> _minutes;
+  HistoryRing<H> _hours;
+  HistoryRing<D> _days;
+  bool _started;
+  unsigned long _lastMs;
+  uint32_t _lastUtc;
+  bool _relayOn, _valveOn;  // As of the last sample
+
+  void _push(uint8_t res, const history_record_t &r) {
+    switch (res) {
+      case HISTORY_MINUTE:  _minutes.push(r);  break;
+      case HISTORY_HOUR:  _hours.push(r);  break;
+      default:  _days.push(r);  break;
+    }
+  }
+
+  static uint8_t* _encode(uint8_t *p, const history_record_t &r) {
+    p = _put32(p, r.start);
+    for (uint8_t i = 0;  i < 3;  i++)
+      p = _put16(p, r.main[i]);
+    for (uint8_t i = 0;  i < 3;  i++)
+      p = _put16(p, r.exchanger[i]);
+    for (uint8_t i = 0;  i < 3;  i++)
+      *p++ = r.level[i];
+    *p++ = r.relayDuty;
+    *p++ = r.valveDuty;
+    return p;
+  }
+
+  static inline uint8_t* _put16(uint8_t* p, uint16_t v) {
+    *p++ = v & 0xff;
+    *p++ = v >> 8;
+    return p;
+  }
+
+  static inline uint8_t* _put32(uint8_t* p, uint32_t v) {
+    p = _put16(p, v & 0xffff);
+    return _put16(p, v >> 16);
+  }
+};
+
+#endif /* __HISTORY_H__ */
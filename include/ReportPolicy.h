@@ -0,0 +1,51 @@
+#ifndef __REPORTPOLICY_H__
+#define __REPORTPOLICY_H__
+
+#include <math.h>
+
+// Report-on-change policy for one telemetry channel.  A value is due if
+// it moved by more than deadband since the last reported value (but no
+// sooner than minIntervalMs after it), or if maxIntervalMs has passed
+// anyway, as a heartbeat.  For discrete values (e.g., levels), use zero
+// deadband and min interval, so every change is reported right away.
+class ReportPolicy {
+public:
+  ReportPolicy(float deadband, uint32_t minIntervalMs, uint32_t maxIntervalMs)
+  : _deadband(deadband), _min(minIntervalMs), _max(maxIntervalMs),
+    _last(0), _lastTime(0), _reported(false) { }
+
+  bool due(float value, unsigned long now) const {
+    if (!_reported)
+      return true;
+    unsigned long elapsed = now - _lastTime;
+    if (elapsed >= _max)
+      return true;
+    return elapsed >= _min && fabsf(value - _last) > _deadband;
+  }
+
+  inline void reported(float value, unsigned long now) {
+    _last = value;
+    _lastTime = now;
+    _reported = true;
+  }
+
+  // If due(), mark as reported and return true
+  bool update(float value, unsigned long now) {
+    if (!due(value, now))
+      return false;
+    reported(value, now);
+    return true;
+  }
+
+  // Next value is due regardless
+  inline void reset() { _reported = false; }
+
+private:
+  float _deadband;
+  uint32_t _min, _max;
+  float _last;
+  unsigned long _lastTime;
+  bool _reported;
+};
+
+#endif /* __REPORTPOLICY_H__ */
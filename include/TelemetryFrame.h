@@ -0,0 +1,120 @@
+#ifndef __TELEMETRYFRAME_H__
+#define __TELEMETRYFRAME_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+// Binary telemetry frame: each record is a snapshot of all channels, with
+// a single timestamp, and a frame carries one or more (e.g., buffered)
+// records.  Fields are little-endian, and packed byte by byte, so the
+// layout does not depend on the compiler; etc/poolbridge.py has the
+// matching decoder.  Bump the version on any layout change.
+//
+//   Header (4 bytes):  'P', version, channel mask, record count
+//   Record (10 bytes): uint32 utc (0 if unknown),
+//                      int16 main and exchanger temperature (centi-'F),
+//                      uint8 water level (level_t),
+//                      uint8 switches (bit 0 relay, bit 1 valve)
+//
+// Records are fixed-size; channels not in the mask are zero, and should
+// be ignored by decoders.
+static const uint8_t TELEMETRY_FRAME_MAGIC = 'P';
+static const uint8_t TELEMETRY_FRAME_VERSION = 1;
+static const uint8_t TELEMETRY_HEADER_SIZE = 4;
+static const uint8_t TELEMETRY_RECORD_SIZE = 10;
+
+typedef enum {
+  TELEMETRY_MAIN_TEMP = 0x01,
+  TELEMETRY_EXCHANGER_TEMP = 0x02,
+  TELEMETRY_WATER_LEVEL = 0x04,
+  TELEMETRY_RELAY = 0x08,
+  TELEMETRY_VALVE = 0x10,
+} telemetry_channel_t;
+
+typedef struct {
+  uint32_t utc;
+  float mainTemperature;
+  float exchangerTemperature;
+  uint8_t waterLevel;
+  bool relayOn;
+  bool valveOn;
+} telemetry_record_t;
+
+// Ring of up to N records, sent as frames of up to MAX_PER_FRAME; when
+// full, the oldest record is dropped.  Usage: while encode() returns a
+// frame, publish it, and consume() the records it holds once sent.
+template <uint16_t N, uint8_t MAX_PER_FRAME>
+class TelemetryBatch {
+public:
+  static const size_t MAX_FRAME_SIZE = TELEMETRY_HEADER_SIZE + MAX_PER_FRAME * TELEMETRY_RECORD_SIZE;
+
+  TelemetryBatch(uint8_t channels) : _channels(channels), _head(0), _count(0), _dropped(0) { }
+
+  void push(const telemetry_record_t& rec) {
+    if (_count == N) {
+      _head = (_head + 1) % N;
+      _count--;
+      _dropped++;
+    }
+    _ring[(_head + _count++) % N] = rec;
+  }
+
+  // Encode oldest records into buf (MAX_FRAME_SIZE bytes); returns frame
+  // size (0 if nothing queued), and number of records in it
+  size_t encode(uint8_t* buf, uint8_t& nRecords) const {
+    nRecords = (_count < MAX_PER_FRAME) ? _count : MAX_PER_FRAME;
+    if (nRecords == 0)
+      return 0;
+    uint8_t* p = buf;
+    *p++ = TELEMETRY_FRAME_MAGIC;
+    *p++ = TELEMETRY_FRAME_VERSION;
+    *p++ = _channels;
+    *p++ = nRecords;
+    for (uint8_t i = 0;  i < nRecords;  i++) {
+      const telemetry_record_t& r = _ring[(_head + i) % N];
+      p = _put32(p, r.utc);
+      p = _put16(p, (_channels & TELEMETRY_MAIN_TEMP) ? _centi(r.mainTemperature) : 0);
+      p = _put16(p, (_channels & TELEMETRY_EXCHANGER_TEMP) ? _centi(r.exchangerTemperature) : 0);
+      *p++ = (_channels & TELEMETRY_WATER_LEVEL) ? r.waterLevel : 0;
+      *p++ = ((_channels & TELEMETRY_RELAY) && r.relayOn ? 0x01 : 0) | ((_channels & TELEMETRY_VALVE) && r.valveOn ? 0x02 : 0);
+    }
+    return p - buf;
+  }
+
+  // Remove n oldest records (i.e., after sending a frame with them)
+  void consume(uint8_t n) {
+    if (n > _count)
+      n = _count;
+    _head = (_head + n) % N;
+    _count -= n;
+  }
+
+  inline uint16_t queued() const { return _count; }
+  inline uint32_t dropped() const { return _dropped; }
+
+private:
+  uint8_t _channels;
+  telemetry_record_t _ring[N];
+  uint16_t _head;
+  uint16_t _count;
+  uint32_t _dropped;
+
+  static inline int16_t _centi(float value) {
+    float c = roundf(value * 100);
+    return (c > INT16_MAX) ? INT16_MAX : (c < INT16_MIN) ? INT16_MIN : (int16_t)c;
+  }
+
+  static inline uint8_t* _put16(uint8_t* p, uint16_t v) {
+    *p++ = v & 0xff;
+    *p++ = v >> 8;
+    return p;
+  }
+
+  static inline uint8_t* _put32(uint8_t* p, uint32_t v) {
+    p = _put16(p, v & 0xffff);
+    return _put16(p, v >> 16);
+  }
+};
+
+#endif /* __TELEMETRYFRAME_H__ */
@@ -0,0 +1,13 @@
+#ifndef __TOPICHASH_H__
+#define __TOPICHASH_H__
+
+#include <stdint.h>
+
+// 32-bit FNV-1a hash of a '\0'-terminated string.  It is constexpr, so
+// that tables keyed on topic strings can be hashed at compile time; the
+// recursion is a tail call, and compiles to a plain loop.
+constexpr uint32_t topic_hash(const char *s, uint32_t h = 2166136261u) {
+  return *s ? topic_hash(s + 1, (h ^ (uint8_t)*s) * 16777619u) : h;
+}
+
+#endif /* __TOPICHASH_H__ */
@@ -7,32 +7,76 @@
 // #define USE_REMOTEDEBUG
 #define HAS_WATER_REFILL
 //#define USE_ADS1115
+#define USE_ADS1115_CONTINUOUS  // With USE_ADS1115: continuous conversion, instead of blocking single-shot reads
+//#define USE_I2S_ADC  // Without USE_ADS1115: DMA (I2S-ADC) sampling with decimation, instead of analogRead()
+#define USE_ADC_FILTER  // Adaptive sample count with median spike rejection, instead of fixed 5-sample average (see ADCFilter.h)
+#define USE_THERMISTOR_TABLE  // Lookup table instead of beta equation (see ThermistorTable.h)
+#define USE_RTOS_TASKS  // Separate, pinned control and network tasks (see setup())
+//#define USE_FIXED_POINT  // Q16.16 instead of float thermistor readings (needs USE_THERMISTOR_TABLE)
+#define USE_LOOP_TIMING  // Per-subsystem latency histograms, published under MQTT_REALM "/diag/timing"
+//#define USE_TELEMETRY_FRAME  // Readings as binary frames on MQTT_REALM "/telemetry", instead of one topic per value (see TelemetryFrame.h)
+#define USE_POWER_SAVE  // Lower/dynamic CPU clock, light sleep when idle (if the SDK supports it), WiFi modem sleep
+//#define USE_OUTBOX_SPILL  // Spill queued MQTT messages to SPIFFS during long outages (see MQTTOutbox.h)
+#define USE_MEMORY_STATS  // Heap, fragmentation and stack high-water marks under MQTT_REALM "/diag/memory", with a low-memory alarm
+//#define USE_TRACE  // Record raw inputs (ADC codes, water level pins, commands) to a SPIFFS ring, or a host file on native, for replay (see Trace.h)
+#define USE_HISTORY  // Per-minute, per-hour and per-day rollups of readings, queried over MQTT_REALM "/history/query" (see History.h)
+
+// Log levels, per module (see Log.h): LOG_NONE, LOG_ERROR, LOG_WARN,
+// LOG_INFO or LOG_DEBUG; anything above a module's level compiles out
+#define LOG_LEVEL_SYSTEM      LOG_INFO
+#define LOG_LEVEL_WIFI        LOG_INFO
+#define LOG_LEVEL_MQTT        LOG_INFO
+#define LOG_LEVEL_OTA         LOG_INFO
+#define LOG_LEVEL_THERMOSTAT  LOG_INFO
+#define LOG_LEVEL_REFILL      LOG_INFO
+#define LOG_LEVEL_TRACE       LOG_INFO
+#define LOG_MQTT_LEVEL        LOG_WARN  // Also published under MQTT_REALM "/diag/log", up to this level
 
 
 /***************************************************************************
  *  Derived, non-editable settings
  ***************************************************************************/
 
-#ifdef USE_ADS1115
-#define THERMISTOR_CONFIG_ADS1115  // For "Thermistor.h"
+#ifndef USE_ADS1115
+#undef USE_ADS1115_CONTINUOUS
+#endif
+
+#if defined(USE_ADS1115) && !defined(USE_ADS1115_CONTINUOUS)
+#define THERMISTOR_CONFIG_ADS1115  // For "Thermistor.h"; single-shot port, via Adafruit library
+#endif
+
+#ifdef POOLSTAT_NATIVE
+#undef USE_RTOS_TASKS  // No scheduler in the mock HAL; loop() runs both sides
+#undef USE_OUTBOX_SPILL  // No flash filesystem in the mock HAL
+#undef USE_I2S_ADC  // No I2S peripheral in the mock HAL
+#endif
+
+#ifdef USE_LOOP_TIMING
+#define LOOPTIMING_CONFIG_ENABLED  // For "LoopTiming.h"; otherwise timers are no-ops
+#endif
+
+#ifdef USE_OUTBOX_SPILL
+#define MQTTOUTBOX_CONFIG_SPIFFS  // For "MQTTOutbox.h"
+#endif
+
+// USE_MEMORY_SITES (allocation counts per call site) is not set here, but
+// by debug environments (see platformio.ini), along with the allocator
+// wrapping it needs
+#ifdef USE_MEMORY_SITES
+#  ifndef USE_MEMORY_STATS
+#    error "USE_MEMORY_SITES requires USE_MEMORY_STATS"
+#  endif
+#define MEMSTATS_CONFIG_SITES  // For "MemStats.h"; otherwise MEM_SITE() is a no-op
+#endif
+
+#if defined(USE_I2S_ADC) && defined(USE_ADS1115)
+#  error "USE_I2S_ADC is for the ESP32's own ADC; disable USE_ADS1115"
+#endif
+
+#if defined(USE_FIXED_POINT) && !defined(USE_THERMISTOR_TABLE)
+#  error "USE_FIXED_POINT requires USE_THERMISTOR_TABLE"
 #endif
 
 #ifdef USE_REMOTEDEBUG
 #  include <RemoteDebug.h>
-// TODO FIXME Avoid double-eval of args!
-#  define DEBUG_BEGINGROUP        rdbg.print("DBG:  ")
-#  define DEBUG_PRINT(val)        rdbg.print(val)
-#  define DEBUG_PRINTF(fmt, ...)  rdbg.printf(fmt, ##__VA_ARGS__)
-#  define DEBUG_ENDGROUP          rdbg.println()
-#  define DEBUG_MSG(fmt, ...)   { rdbg.print("DBG:  "); rdbg.printf(fmt, ##__VA_ARGS__); rdbg.println(); }
-
-#  define INFO_MSG(fmt, ...)    { rdbg.print("INFO: "); rdbg.printf(fmt, ##__VA_ARGS__); rdbg.println(); }
-#else
-#  define DEBUG_BEGINGROUP        Serial.print("DBG:  ")
-#  define DEBUG_PRINT(val)        Serial.print(val)
-#  define DEBUG_PRINTF(fmt, ...)  Serial.printf(fmt, ##__VA_ARGS__)
-#  define DEBUG_ENDGROUP          Serial.println()
-#  define DEBUG_MSG(fmt, ...)   { Serial.print("DBG:  "); Serial.printf(fmt, ##__VA_ARGS__); Serial.println(); }
-
-#  define INFO_MSG(fmt, ...)    { Serial.print("INFO: "); Serial.printf(fmt, ##__VA_ARGS__); Serial.println(); }
 #endif
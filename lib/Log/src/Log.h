@@ -0,0 +1,133 @@
+#ifndef __LOG_H__
+#define __LOG_H__
+
+#include <Arduino.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <atomic>
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+
+typedef enum : uint8_t { LOG_NONE, LOG_ERROR, LOG_WARN, LOG_INFO, LOG_DEBUG } log_level_t;
+
+// Leveled messages, per module: LOG_I(WIFI, "connected to %s", ssid)
+// checks against LOG_LEVEL_WIFI, which must be defined (e.g., in
+// config.h) as one of the log_level_t values.  The check is a constant,
+// so messages above a module's level compile to nothing; enabled ones
+// are formatted right away (arguments are evaluated exactly once) into
+// LOG_RING, and written out later by whoever drains it.
+#ifndef LOG_RING
+#define LOG_RING logRing  // The application's LogRing instance
+#endif
+
+#define LOG(module, level, fmt, ...) \
+  do { \
+    if ((level) <= LOG_LEVEL_##module) \
+      LOG_RING.printf((level), #module, fmt, ##__VA_ARGS__); \
+  } while (0)
+
+#define LOG_E(module, fmt, ...)  LOG(module, LOG_ERROR, fmt, ##__VA_ARGS__)
+#define LOG_W(module, fmt, ...)  LOG(module, LOG_WARN, fmt, ##__VA_ARGS__)
+#define LOG_I(module, fmt, ...)  LOG(module, LOG_INFO, fmt, ##__VA_ARGS__)
+#define LOG_D(module, fmt, ...)  LOG(module, LOG_DEBUG, fmt, ##__VA_ARGS__)
+
+// Bounded queue of N formatted lines, of up to LEN-1 characters (longer
+// ones are cut short, but keep their line ending).  Any number of tasks
+// may log, and one drains (see peek() and pop()); neither side takes a
+// lock or waits for the other (a bounded MPMC queue, with a sequence
+// number per slot, after D. Vyukov).  When full, new messages are dropped
+// and counted.  Not for use in ISRs (vsnprintf).
+template <uint8_t N, uint8_t LEN = 96>
+class LogRing {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "LogRing size must be a power of two");
+
+public:
+  struct Entry {
+    log_level_t level;
+    uint8_t length;  // Of text, without the '\0'
+    char text[LEN];  // "<millis> <E|W|I|D> <module>: <message>\r\n"
+  };
+
+  LogRing() : _enqueue(0), _dequeue(0), _dropped(0) {
+    for (uint32_t i = 0;  i < N;  i++)
+      _slots[i].seq.store(i, std::memory_order_relaxed);
+  }
+
+  void printf(log_level_t level, const char *module, const char *fmt, ...) __attribute__((format(printf, 4, 5))) {
+    Slot *slot = _reserve();
+    if (!slot)
+      return;
+    static const char LEVEL_CHARS[] = "-EWID";
+    Entry &e = slot->entry;
+    int n = snprintf(e.text, LEN, "%lu %c %s: ", (unsigned long)millis(), LEVEL_CHARS[level], module);
+    if (n < 0 || n >= LEN - 2)
+      n = 0;
+    va_list args;
+    va_start(args, fmt);
+    int m = vsnprintf(e.text + n, LEN - 2 - n, fmt, args);
+    va_end(args);
+    n = (m < 0) ? n : (m >= LEN - 2 - n) ? LEN - 3 : n + m;
+    e.text[n++] = '\r';
+    e.text[n++] = '\n';
+    e.text[n] = '\0';
+    e.level = level;
+    e.length = n;
+    slot->seq.store(slot->pos + 1, std::memory_order_release);
+  }
+
+  // Consumer side: oldest complete entry (NULL if none), which stays
+  // valid, and at the front, until pop()
+  const Entry *peek() const {
+    const Slot &slot = _slots[_dequeue & (N - 1)];
+    if (slot.seq.load(std::memory_order_acquire) != _dequeue + 1)
+      return NULL;
+    return &slot.entry;
+  }
+
+  void pop() {
+    Slot &slot = _slots[_dequeue & (N - 1)];
+    slot.seq.store(_dequeue + N, std::memory_order_release);
+    _dequeue++;
+  }
+
+  // Messages dropped since the last call
+  uint32_t takeDropped() {
+    return _dropped.exchange(0, std::memory_order_relaxed);
+  }
+
+private:
+  struct Slot {
+    std::atomic<uint32_t> seq;
+    uint32_t pos;
+    Entry entry;
+  };
+
+  Slot _slots[N];
+  std::atomic<uint32_t> _enqueue;
+  uint32_t _dequeue;  // Consumer only
+  std::atomic<uint32_t> _dropped;
+
+  Slot *_reserve() {
+    uint32_t pos = _enqueue.load(std::memory_order_relaxed);
+    for (;;) {
+      Slot &slot = _slots[pos & (N - 1)];
+      int32_t diff = (int32_t)(slot.seq.load(std::memory_order_acquire) - pos);
+      if (diff == 0) {
+        if (_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          slot.pos = pos;
+          return &slot;
+        }
+      } else if (diff < 0) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return NULL;  // Full
+      } else {
+        pos = _enqueue.load(std::memory_order_relaxed);
+      }
+    }
+  }
+};
+
+#endif /* __LOG_H__ */
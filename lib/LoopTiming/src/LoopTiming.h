@@ -0,0 +1,155 @@
+#ifndef __LOOPTIMING_H__
+#define __LOOPTIMING_H__
+
+#include <Arduino.h>
+
+#include <atomic>
+
+/***************************************************************************
+ * 
+ ***************************************************************************/
+
+// Latency histogram (in usec) with fixed, log-linear buckets: values
+// below 4 are exact, and every power of two above that is split in 4
+// (i.e., within 25%).  Values of 2^MAX_BITS usec (~1 sec) and over all
+// land in an overflow bucket, but peak() is always exact.
+class LatencyHistogram {
+public:
+  static const uint8_t SUB_BITS = 2;
+  static const uint8_t MAX_BITS = 20;
+  static const uint8_t NUM_BUCKETS = ((MAX_BITS - SUB_BITS + 1) << SUB_BITS) + 1;  // Last is overflow
+
+  LatencyHistogram() { reset(); }
+
+  void reset() {
+    memset(_buckets, 0, sizeof(_buckets));
+    _count = 0;
+    _max = 0;
+  }
+
+  inline void record(uint32_t us) {
+    _buckets[_bucket(us)]++;
+    _count++;
+    if (us > _max)
+      _max = us;
+  }
+
+  inline uint32_t count() const { return _count; }
+  inline uint32_t peak() const { return _max; }
+
+  // Upper bound of the bucket holding the pct-th percentile value
+  uint32_t percentile(uint8_t pct) const {
+    if (_count == 0)
+      return 0;
+    uint32_t target = ((uint64_t)_count * pct + 99) / 100;
+    uint32_t seen = 0;
+    for (uint8_t i = 0;  i < NUM_BUCKETS;  i++) {
+      seen += _buckets[i];
+      if (seen >= target && seen > 0)
+        return (_upper(i) < _max) ? _upper(i) : _max;
+    }
+    return _max;
+  }
+
+private:
+  uint32_t _buckets[NUM_BUCKETS];
+  uint32_t _count;
+  uint32_t _max;
+
+  static inline uint8_t _bucket(uint32_t us) {
+    if (us < (1u << SUB_BITS))
+      return us;
+    if (us >= (1u << MAX_BITS))
+      return NUM_BUCKETS - 1;
+    uint8_t msb = 31 - __builtin_clz(us);
+    return ((msb - SUB_BITS + 1) << SUB_BITS) | ((us >> (msb - SUB_BITS)) & ((1u << SUB_BITS) - 1));
+  }
+
+  static inline uint32_t _upper(uint8_t bucket) {
+    if (bucket < (1u << SUB_BITS))
+      return bucket;
+    if (bucket == NUM_BUCKETS - 1)
+      return UINT32_MAX;
+    uint8_t shift = (bucket >> SUB_BITS) - 1;  // i.e., msb - SUB_BITS
+    uint32_t sub = bucket & ((1u << SUB_BITS) - 1);
+    return (((1u << SUB_BITS) + sub + 1) << shift) - 1;
+  }
+};
+
+// Records time from construction until end of scope
+class ScopedTimer {
+public:
+  ScopedTimer(LatencyHistogram &hist) : _hist(hist), _start(micros()) { }
+  ~ScopedTimer() { _hist.record(micros() - _start); }
+private:
+  LatencyHistogram &_hist;
+  unsigned long _start;
+};
+
+// Summary of one histogram, over one reporting period
+typedef struct {
+  uint32_t count;
+  uint32_t p50, p99, max;
+} timing_summary_t;
+
+// N histograms, owned (i.e., recorded into) by a single task.  Another
+// task can request() summaries; the owner computes them (and starts a
+// new period) at its next poll(), after which they can be read until
+// release()'d.  Histograms themselves never cross tasks.
+template <uint8_t N>
+class TimingGroup {
+public:
+  TimingGroup() : _state(IDLE), _periodStart(micros()), _periodUs(0) { }
+
+  inline LatencyHistogram &operator[](uint8_t i) { return _hists[i]; }
+
+  // Owner side; call once per pass
+  void poll() {
+    if (_state.load(std::memory_order_acquire) != REQUESTED)
+      return;
+    unsigned long now = micros();
+    _periodUs = now - _periodStart;
+    _periodStart = now;
+    for (uint8_t i = 0;  i < N;  i++) {
+      _summaries[i].count = _hists[i].count();
+      _summaries[i].p50 = _hists[i].percentile(50);
+      _summaries[i].p99 = _hists[i].percentile(99);
+      _summaries[i].max = _hists[i].peak();
+      _hists[i].reset();
+    }
+    _state.store(READY, std::memory_order_release);
+  }
+
+  // Reader side
+  inline void request() {
+    uint8_t idle = IDLE;
+    _state.compare_exchange_strong(idle, REQUESTED, std::memory_order_acq_rel);
+  }
+  inline bool ready() const { return _state.load(std::memory_order_acquire) == READY; }
+  inline const timing_summary_t &summary(uint8_t i) const { return _summaries[i]; }
+  inline uint32_t periodUs() const { return _periodUs; }
+  inline void release() { _state.store(IDLE, std::memory_order_release); }
+
+private:
+  enum : uint8_t { IDLE, REQUESTED, READY };
+
+  LatencyHistogram _hists[N];
+  std::atomic<uint8_t> _state;
+  unsigned long _periodStart;
+  uint32_t _periodUs;
+  timing_summary_t _summaries[N];
+};
+
+// Instrumentation macros; no-ops unless LOOPTIMING_CONFIG_ENABLED
+#define _LOOPTIMING_CONCAT2(a, b)  a##b
+#define _LOOPTIMING_CONCAT(a, b)  _LOOPTIMING_CONCAT2(a, b)
+
+#ifdef LOOPTIMING_CONFIG_ENABLED
+#  define TIME_SCOPE(group, timer)  ScopedTimer _LOOPTIMING_CONCAT(_scopedTimer, __LINE__)((group)[timer])
+#  define TIMED(group, timer, stmt)  { ScopedTimer _scopedTimer((group)[timer]);  stmt; }
+#else
+#  define TIME_SCOPE(group, timer)
+#  define TIMED(group, timer, stmt)  { stmt; }
+#endif
+
+#endif /* __LOOPTIMING_H__ */
@@ -0,0 +1,189 @@
+#ifndef __MQTTOUTBOX_H__
+#define __MQTTOUTBOX_H__
+
+#include <Arduino.h>
+#include <PubSubClient.h>
+
+#ifdef MQTTOUTBOX_CONFIG_SPIFFS
+#include <FS.h>
+#endif
+
+/***************************************************************************
+ * 
+ ***************************************************************************/
+
+// Store-and-forward queue for outgoing messages.  publish() sends right
+// away when connected (and nothing older is pending); otherwise, the
+// message is kept in a preallocated ring of N entries, and flush() sends
+// queued messages, oldest first, once the connection is back.  When the
+// ring is full, the oldest message is either spilled to flash (if
+// enabled with MQTTOUTBOX_CONFIG_SPIFFS and spillTo()) or dropped.
+//
+// Messages that were held back are sent with their original timestamp
+// (if known) appended to the payload, as "<payload>@<utc_seconds>", so
+// that consumers (e.g., etc/poolbridge.py) can record them at the right
+// time.  Topics are stored by pointer, so they must have static storage
+// (e.g., the MQTT_TOPIC_* constants).
+template <uint16_t N>
+class MQTTOutbox {
+public:
+  static const uint8_t MAX_PAYLOAD = 24;  // Including '\0'
+  static const uint8_t MAX_TOPIC = 48;  // Including '\0'; spilled messages only
+  static const uint32_t NO_TIMESTAMP = 0;
+
+  MQTTOutbox(PubSubClient& client)
+  : _client(client), _head(0), _count(0), _dropped(0)
+#ifdef MQTTOUTBOX_CONFIG_SPIFFS
+    , _fs(NULL), _spillPath(NULL), _spillMax(0), _spillPos(0), _spillSize(0)
+#endif
+  { }
+
+  // Returns false only if the message could not be sent or queued
+  bool publish(const char* topic, const char* payload, uint32_t timestamp = NO_TIMESTAMP) {
+    if (!_pending() && _client.connected() && _client.publish(topic, payload))
+      return true;
+    if (strlen(payload) >= MAX_PAYLOAD)
+      return false;
+    if (_count == N)
+      _evict();
+    Message& m = _ring[(_head + _count++) % N];
+    m.topic = topic;
+    m.timestamp = timestamp;
+    strcpy(m.payload, payload);
+    return true;
+  }
+
+  // Send up to maxMessages queued messages; returns number sent
+  uint16_t flush(uint16_t maxMessages) {
+    uint16_t sent = 0;
+#ifdef MQTTOUTBOX_CONFIG_SPIFFS
+    while (sent < maxMessages && _spillPos < _spillSize && _client.connected()) {
+      if (!_unspill())
+        return sent;
+      sent++;
+    }
+#endif
+    while (sent < maxMessages && _count > 0 && _client.connected()) {
+      const Message& m = _ring[_head];
+      if (!_send(m.topic, m.payload, m.timestamp))
+        break;
+      _head = (_head + 1) % N;
+      _count--;
+      sent++;
+    }
+    return sent;
+  }
+
+  inline uint16_t queued() const { return _count; }
+  inline uint32_t dropped() const { return _dropped; }
+
+#ifdef MQTTOUTBOX_CONFIG_SPIFFS
+  // Spill overflow to a file (removed once fully replayed), up to maxBytes
+  void spillTo(fs::FS& fs, const char* path, size_t maxBytes) {
+    _fs = &fs;
+    _spillPath = path;
+    _spillMax = maxBytes;
+    _fs->remove(_spillPath);  // Stale from before reboot; topics are fine, but order is not
+    _spillPos = _spillSize = 0;
+  }
+  inline size_t spilled() const { return (_spillSize - _spillPos) / sizeof(SpillRecord); }
+#endif
+
+private:
+  struct Message {
+    const char* topic;
+    uint32_t timestamp;
+    char payload[MAX_PAYLOAD];
+  };
+
+  PubSubClient& _client;
+  Message _ring[N];
+  uint16_t _head;
+  uint16_t _count;
+  uint32_t _dropped;
+
+  inline bool _pending() const {
+#ifdef MQTTOUTBOX_CONFIG_SPIFFS
+    if (_spillPos < _spillSize)
+      return true;
+#endif
+    return _count > 0;
+  }
+
+  bool _send(const char* topic, const char* payload, uint32_t timestamp) {
+    if (timestamp == NO_TIMESTAMP)
+      return _client.publish(topic, payload);
+    char buf[MAX_PAYLOAD + 12];
+    snprintf(buf, sizeof(buf), "%s@%lu", payload, (unsigned long)timestamp);
+    return _client.publish(topic, buf);
+  }
+
+  // Make room for one message, at the head of the ring
+  void _evict() {
+#ifdef MQTTOUTBOX_CONFIG_SPIFFS
+    if (!_spill(_ring[_head]))
+      _dropped++;
+#else
+    _dropped++;
+#endif
+    _head = (_head + 1) % N;
+    _count--;
+  }
+
+#ifdef MQTTOUTBOX_CONFIG_SPIFFS
+  struct SpillRecord {
+    uint32_t timestamp;
+    char topic[MAX_TOPIC];
+    char payload[MAX_PAYLOAD];
+  };
+
+  fs::FS* _fs;
+  const char* _spillPath;
+  size_t _spillMax;
+  size_t _spillPos;  // Next record to replay
+  size_t _spillSize;
+
+  bool _spill(const Message& m) {
+    if (!_fs || _spillSize + sizeof(SpillRecord) > _spillMax || strlen(m.topic) >= MAX_TOPIC)
+      return false;
+    SpillRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.timestamp = m.timestamp;
+    strcpy(rec.topic, m.topic);
+    strcpy(rec.payload, m.payload);
+    File f = _fs->open(_spillPath, FILE_APPEND);
+    if (!f)
+      return false;
+    bool ok = (f.write((const uint8_t*)&rec, sizeof(rec)) == sizeof(rec));
+    f.close();
+    if (ok)
+      _spillSize += sizeof(rec);
+    return ok;
+  }
+
+  bool _unspill() {
+    SpillRecord rec;
+    File f = _fs->open(_spillPath, FILE_READ);
+    if (!f || !f.seek(_spillPos) || f.read((uint8_t*)&rec, sizeof(rec)) != sizeof(rec)) {
+      // Unreadable; give up on the rest of the spill file
+      if (f)
+        f.close();
+      _dropped += (_spillSize - _spillPos) / sizeof(SpillRecord);
+      _fs->remove(_spillPath);
+      _spillPos = _spillSize = 0;
+      return false;
+    }
+    f.close();
+    if (!_send(rec.topic, rec.payload, rec.timestamp))
+      return false;
+    _spillPos += sizeof(rec);
+    if (_spillPos >= _spillSize) {
+      _fs->remove(_spillPath);
+      _spillPos = _spillSize = 0;
+    }
+    return true;
+  }
+#endif
+};
+
+#endif /* __MQTTOUTBOX_H__ */
@@ -0,0 +1,104 @@
+#ifndef __MEMSTATS_H__
+#define __MEMSTATS_H__
+
+#include <Arduino.h>
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+
+// Heap snapshot, via the Arduino core (internal, 8-bit capable RAM)
+typedef struct {
+  uint32_t freeHeap;
+  uint32_t largestBlock;  // Largest single allocation that can succeed
+  uint32_t minFreeHeap;  // Low-water mark, since boot
+} mem_stats_t;
+
+inline void memReadStats(mem_stats_t &s) {
+  s.freeHeap = ESP.getFreeHeap();
+  s.largestBlock = ESP.getMaxAllocHeap();
+  s.minFreeHeap = ESP.getMinFreeHeap();
+}
+
+// Fraction of free heap that is not in the largest block: 0 when it is
+// all contiguous, towards 1 as it breaks up into small holes
+inline float memFragmentation(const mem_stats_t &s) {
+  return s.freeHeap ? 1.0f - (float)s.largestBlock / s.freeHeap : 0.0f;
+}
+
+// Raised when the largest free block or the free heap drops below its
+// threshold, and cleared once both are back above it by marginPercent,
+// so a level hovering around a threshold does not flap.  Thresholds
+// should cover the biggest allocation that must not fail (e.g., a
+// reconnect), with room to act.
+class MemAlarm {
+public:
+  MemAlarm(uint32_t minLargestBlock, uint32_t minFreeHeap, uint8_t marginPercent = 25)
+  : _minBlock(minLargestBlock), _minFree(minFreeHeap), _margin(marginPercent), _on(false) { }
+
+  // Returns true if the alarm was raised or cleared
+  bool update(const mem_stats_t &s) {
+    if (!_on && (s.largestBlock < _minBlock || s.freeHeap < _minFree)) {
+      _on = true;
+      return true;
+    }
+    if (_on && s.largestBlock >= _above(_minBlock) && s.freeHeap >= _above(_minFree)) {
+      _on = false;
+      return true;
+    }
+    return false;
+  }
+
+  inline bool on() const { return _on; }
+
+private:
+  uint32_t _minBlock, _minFree;
+  uint8_t _margin;
+  bool _on;
+
+  inline uint32_t _above(uint32_t threshold) const {
+    return threshold + threshold / 100 * _margin;
+  }
+};
+
+/***************************************************************************
+ * Allocation counts per call site (debug builds)
+ ***************************************************************************/
+
+// MEM_SITE(counter) counts heap allocations made by the calling task,
+// until the end of the enclosing scope, into counter (a uint32_t); with
+// nested sites, the innermost one gets them.  The allocator must call
+// MemSite::count() on every allocation, e.g. from a malloc() wrapper
+// (with the linker's --wrap) or a replacement operator new.  Without
+// MEMSTATS_CONFIG_SITES, it compiles to nothing.
+#define _MEMSTATS_CONCAT2(a, b)  a##b
+#define _MEMSTATS_CONCAT(a, b)  _MEMSTATS_CONCAT2(a, b)
+
+#ifdef MEMSTATS_CONFIG_SITES
+class MemSite {
+public:
+  MemSite(uint32_t &counter) : _outer(_current()) { _current() = &counter; }
+  ~MemSite() { _current() = _outer; }
+
+  static inline void count() {
+    uint32_t *counter = _current();
+    if (counter)
+      (*counter)++;
+  }
+
+private:
+  uint32_t *_outer;
+
+  // Per task; constant-initialized, so no allocation of its own
+  static inline uint32_t *&_current() {
+    static thread_local uint32_t *current = NULL;
+    return current;
+  }
+};
+
+#  define MEM_SITE(counter)  MemSite _MEMSTATS_CONCAT(_memSite, __LINE__)(counter)
+#else
+#  define MEM_SITE(counter)
+#endif
+
+#endif /* __MEMSTATS_H__ */
@@ -0,0 +1,108 @@
+#ifndef __NATIVEHAL_ARDUINO_H__
+#define __NATIVEHAL_ARDUINO_H__
+
+// Mock Arduino core, for host (native) builds; see NativeHAL.h for the
+// simulation-side controls (virtual time, pin values, network state)
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
+using std::min;
+using std::max;
+
+#include "Print.h"
+#include "WString.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define LOW     0x0
+#define HIGH    0x1
+
+#define INPUT             0x01
+#define OUTPUT            0x02
+#define INPUT_PULLUP      0x05
+#define INPUT_PULLDOWN    0x09
+
+#define RISING    0x01
+#define FALLING   0x02
+#define CHANGE    0x03
+
+#define IRAM_ATTR  // No instruction RAM on the host
+#define PROGMEM  // Nor separate flash
+#define pgm_read_byte(addr)  (*(const uint8_t *)(addr))
+
+#define HEX 16
+#define DEC 10
+
+static const uint8_t SDA = 21;
+static const uint8_t SCL = 22;
+
+/***************************************************************************
+ * Time (virtual)
+ ***************************************************************************/
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+/***************************************************************************
+ * GPIO and ADC
+ ***************************************************************************/
+
+typedef enum { ADC_0db, ADC_2_5db, ADC_6db, ADC_11db } adc_attenuation_t;
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+#define digitalPinToInterrupt(p)  (p)
+// Handlers run synchronously, from setDigitalInput() (see NativeHAL.h)
+void attachInterrupt(uint8_t pin, void (*handler)(void), int mode);
+void attachInterruptArg(uint8_t pin, void (*handler)(void *), void *arg, int mode);
+void detachInterrupt(uint8_t pin);
+
+uint16_t analogRead(uint8_t pin);
+void analogReadResolution(uint8_t bits);
+void analogSetAttenuation(adc_attenuation_t attenuation);
+void analogSetPinAttenuation(uint8_t pin, adc_attenuation_t attenuation);
+
+/***************************************************************************
+ * Misc
+ ***************************************************************************/
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+bool setCpuFrequencyMhz(uint32_t mhz);
+uint32_t getCpuFrequencyMhz();
+
+class HardwareSerial : public Print {
+public:
+  void begin(unsigned long baud) { (void)baud; }
+  virtual size_t write(uint8_t c) override;
+  using Print::write;
+  int availableForWrite() { return 4096; }  // Never backs up
+};
+
+extern HardwareSerial Serial;
+
+// Heap figures only; see NativeHAL::setHeap()
+class EspClass {
+public:
+  uint32_t getHeapSize();
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+  uint32_t getMaxAllocHeap();
+};
+
+extern EspClass ESP;
+
+#endif /* __NATIVEHAL_ARDUINO_H__ */
@@ -0,0 +1,44 @@
+#ifndef __NATIVEHAL_ARDUINOOTA_H__
+#define __NATIVEHAL_ARDUINOOTA_H__
+
+#include <Arduino.h>
+#include <functional>
+
+#define U_FLASH   0
+#define U_SPIFFS  100
+
+typedef enum {
+  OTA_AUTH_ERROR, OTA_BEGIN_ERROR, OTA_CONNECT_ERROR, OTA_RECEIVE_ERROR, OTA_END_ERROR
+} ota_error_t;
+
+// Never receives an update; handlers are only stored
+class ArduinoOTAClass {
+public:
+  typedef std::function<void(void)> THandlerFunction;
+  typedef std::function<void(ota_error_t)> THandlerFunction_Error;
+  typedef std::function<void(unsigned int, unsigned int)> THandlerFunction_Progress;
+
+  ArduinoOTAClass &setHostname(const char *hostname) { (void)hostname; return *this; }
+  ArduinoOTAClass &setPassword(const char *password) { (void)password; return *this; }
+  ArduinoOTAClass &setPort(uint16_t port) { (void)port; return *this; }
+
+  ArduinoOTAClass &onStart(THandlerFunction fn) { _startCallback = fn; return *this; }
+  ArduinoOTAClass &onEnd(THandlerFunction fn) { _endCallback = fn; return *this; }
+  ArduinoOTAClass &onError(THandlerFunction_Error fn) { _errorCallback = fn; return *this; }
+  ArduinoOTAClass &onProgress(THandlerFunction_Progress fn) { _progressCallback = fn; return *this; }
+
+  void begin() { }
+  void end() { }
+  void handle() { }
+  int getCommand() { return U_FLASH; }
+
+private:
+  THandlerFunction _startCallback;
+  THandlerFunction _endCallback;
+  THandlerFunction_Error _errorCallback;
+  THandlerFunction_Progress _progressCallback;
+};
+
+extern ArduinoOTAClass ArduinoOTA;
+
+#endif /* __NATIVEHAL_ARDUINOOTA_H__ */
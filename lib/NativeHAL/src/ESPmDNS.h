@@ -0,0 +1,17 @@
+#ifndef __NATIVEHAL_ESPMDNS_H__
+#define __NATIVEHAL_ESPMDNS_H__
+
+#include <Arduino.h>
+
+class MDNSResponder {
+public:
+  bool begin(const char *hostName) { (void)hostName; return true; }
+  void end() { }
+  void addService(const char *service, const char *proto, uint16_t port) {
+    (void)service;  (void)proto;  (void)port;
+  }
+};
+
+extern MDNSResponder MDNS;
+
+#endif /* __NATIVEHAL_ESPMDNS_H__ */
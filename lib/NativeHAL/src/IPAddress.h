@@ -0,0 +1,25 @@
+#ifndef __NATIVEHAL_IPADDRESS_H__
+#define __NATIVEHAL_IPADDRESS_H__
+
+#include <stdio.h>
+#include "WString.h"
+
+class IPAddress {
+public:
+  IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0) {
+    _addr[0] = a;  _addr[1] = b;  _addr[2] = c;  _addr[3] = d;
+  }
+
+  uint8_t operator[](int index) const { return _addr[index]; }
+
+  String toString() const {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", _addr[0], _addr[1], _addr[2], _addr[3]);
+    return String(buf);
+  }
+
+private:
+  uint8_t _addr[4];
+};
+
+#endif /* __NATIVEHAL_IPADDRESS_H__ */
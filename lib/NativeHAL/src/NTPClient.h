@@ -0,0 +1,31 @@
+#ifndef __NATIVEHAL_NTPCLIENT_H__
+#define __NATIVEHAL_NTPCLIENT_H__
+
+#include <Arduino.h>
+#include <WiFiUdp.h>
+
+// Wall clock is NativeHAL's epoch plus virtual time
+class NTPClient {
+public:
+  NTPClient(UDP &udp, long timeOffset = 0) : _timeOffset(timeOffset) { (void)udp; }
+
+  void begin() { }
+  void end() { }
+  bool update() { return true; }
+  bool forceUpdate() { return true; }
+  bool isTimeSet() const { return true; }
+
+  void setTimeOffset(int timeOffset) { _timeOffset = timeOffset; }
+  void setUpdateInterval(unsigned long updateInterval) { (void)updateInterval; }
+
+  unsigned long getEpochTime() const;
+  int getDay() const { return (((getEpochTime() / 86400L) + 4) % 7); }  // 0 is Sunday
+  int getHours() const { return ((getEpochTime() % 86400L) / 3600); }
+  int getMinutes() const { return ((getEpochTime() % 3600) / 60); }
+  int getSeconds() const { return (getEpochTime() % 60); }
+
+private:
+  long _timeOffset;
+};
+
+#endif /* __NATIVEHAL_NTPCLIENT_H__ */
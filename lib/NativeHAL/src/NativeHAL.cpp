@@ -0,0 +1,843 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <PubSubClient.h>
+#include <NTPClient.h>
+#include <ESPmDNS.h>
+#include <ArduinoOTA.h>
+#include <U8x8lib.h>
+#include <Wire.h>
+
+#include "NativeHAL.h"
+#include <Trace.h>
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <deque>
+#include <new>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+/***************************************************************************
+ * Simulation state
+ ***************************************************************************/
+
+namespace NativeHAL {
+
+bool verbose = true;
+unsigned long bootEpoch = 1596240000UL;  // 2020-08-01 00:00:00 UTC
+PublishHook onPublish = NULL;
+ExitHook onExit = NULL;
+AllocHook onAllocate = NULL;
+
+static uint64_t _now = 0;
+static uint64_t _idle = 0;
+static uint32_t _cpuMhz = 240;
+
+// Typical for the Arduino core with WiFi up
+static const uint32_t HEAP_SIZE = 327680;
+static uint32_t _heapFree = 190000;
+static uint32_t _heapLargest = 110000;
+static uint32_t _heapMinFree = _heapFree;
+
+struct pin_state_t {
+  uint8_t mode;
+  uint8_t level;
+  bool driven;  // Externally, via setDigitalInput()
+  uint16_t analog;
+  // Attached interrupt, if any
+  int isrMode;
+  void (*isr)(void);
+  void (*isrArg)(void *);
+  void *arg;
+};
+static pin_state_t _pins[NUM_PINS];
+
+static bool _wifiAvailable = true;
+static bool _brokerAvailable = true;
+static std::deque<std::pair<std::string, std::string> > _inbox;
+
+uint64_t now() { return _now; }
+void advance(uint64_t us) { _now += us; }
+uint64_t idleTime() { return _idle; }
+
+uint64_t wallNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void setAnalogInput(uint8_t pin, uint16_t code) {
+  if (pin < NUM_PINS)
+    _pins[pin].analog = code;
+}
+
+void setDigitalInput(uint8_t pin, int level) {
+  if (pin >= NUM_PINS)
+    return;
+  pin_state_t &p = _pins[pin];
+  p.driven = true;
+  if (p.mode == OUTPUT)
+    return;
+  uint8_t prev = p.level;
+  p.level = level ? HIGH : LOW;
+  if (p.level == prev)
+    return;
+  int edge = (p.level == HIGH) ? RISING : FALLING;
+  if (!(p.isrMode & edge))
+    return;
+  if (p.isr)
+    p.isr();
+  else if (p.isrArg)
+    p.isrArg(p.arg);
+}
+
+int pinLevel(uint8_t pin) {
+  return (pin < NUM_PINS) ? _pins[pin].level : LOW;
+}
+
+void setWiFiAvailable(bool available) { _wifiAvailable = available; }
+bool wifiAvailable() { return _wifiAvailable; }
+void setBrokerAvailable(bool available) { _brokerAvailable = available; }
+bool brokerAvailable() { return _brokerAvailable; }
+
+void injectMessage(const char *topic, const char *payload) {
+  _inbox.push_back(std::make_pair(std::string(topic), std::string(payload)));
+}
+
+}  // namespace NativeHAL
+
+using namespace NativeHAL;
+
+/***************************************************************************
+ * Arduino core
+ ***************************************************************************/
+
+unsigned long millis() { return (unsigned long)(_now / 1000); }
+unsigned long micros() { return (unsigned long)_now; }
+void delay(uint32_t ms) {
+  _now += (uint64_t)ms * 1000;
+  _idle += (uint64_t)ms * 1000;
+}
+void delayMicroseconds(uint32_t us) { _now += us; }
+void yield() { }
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin >= NUM_PINS)
+    return;
+  _pins[pin].mode = mode;
+  if (mode == INPUT_PULLUP && !_pins[pin].driven)
+    _pins[pin].level = HIGH;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  if (pin < NUM_PINS)
+    _pins[pin].level = val ? HIGH : LOW;
+}
+
+int digitalRead(uint8_t pin) {
+  return pinLevel(pin);
+}
+
+void attachInterrupt(uint8_t pin, void (*handler)(void), int mode) {
+  if (pin >= NUM_PINS)
+    return;
+  _pins[pin].isrMode = mode;
+  _pins[pin].isr = handler;
+  _pins[pin].isrArg = NULL;
+}
+
+void attachInterruptArg(uint8_t pin, void (*handler)(void *), void *arg, int mode) {
+  if (pin >= NUM_PINS)
+    return;
+  _pins[pin].isrMode = mode;
+  _pins[pin].isr = NULL;
+  _pins[pin].isrArg = handler;
+  _pins[pin].arg = arg;
+}
+
+void detachInterrupt(uint8_t pin) {
+  if (pin < NUM_PINS)
+    _pins[pin].isrMode = 0;
+}
+
+uint16_t analogRead(uint8_t pin) {
+  return (pin < NUM_PINS) ? _pins[pin].analog : 0;
+}
+
+void analogReadResolution(uint8_t bits) { (void)bits; }
+void analogSetAttenuation(adc_attenuation_t attenuation) { (void)attenuation; }
+void analogSetPinAttenuation(uint8_t pin, adc_attenuation_t attenuation) { (void)pin;  (void)attenuation; }
+
+long random(long howbig) {
+  return (howbig <= 0) ? 0 : (::random() % howbig);
+}
+
+long random(long howsmall, long howbig) {
+  return (howsmall >= howbig) ? howsmall : howsmall + random(howbig - howsmall);
+}
+
+void randomSeed(unsigned long seed) {
+  if (seed != 0)
+    ::srandom(seed);
+}
+
+bool setCpuFrequencyMhz(uint32_t mhz) {
+  _cpuMhz = mhz;
+  return true;
+}
+
+uint32_t getCpuFrequencyMhz() { return _cpuMhz; }
+
+HardwareSerial Serial;
+
+void NativeHAL::setHeap(uint32_t freeBytes, uint32_t largestBlock) {
+  _heapFree = freeBytes;
+  _heapLargest = std::min(largestBlock, freeBytes);
+  _heapMinFree = std::min(_heapMinFree, freeBytes);
+}
+
+EspClass ESP;
+
+uint32_t EspClass::getHeapSize() { return HEAP_SIZE; }
+uint32_t EspClass::getFreeHeap() { return _heapFree; }
+uint32_t EspClass::getMinFreeHeap() { return _heapMinFree; }
+uint32_t EspClass::getMaxAllocHeap() { return _heapLargest; }
+
+size_t HardwareSerial::write(uint8_t c) {
+  if (verbose)
+    fputc(c, stdout);
+  return 1;
+}
+
+/***************************************************************************
+ * Print and String
+ ***************************************************************************/
+
+size_t Print::write(const char *str) {
+  return str ? write((const uint8_t *)str, strlen(str)) : 0;
+}
+
+size_t Print::write(const uint8_t *buf, size_t size) {
+  size_t n = 0;
+  while (size--)
+    n += write(*buf++);
+  return n;
+}
+
+size_t Print::print(const String &str) { return write(str.c_str()); }
+size_t Print::print(long val, int base) { return print(String(val, (unsigned char)base)); }
+size_t Print::print(unsigned long val, int base) { return print(String(val, (unsigned char)base)); }
+size_t Print::print(double val, int digits) { return print(String(val, (unsigned char)digits)); }
+
+size_t Print::printf(const char *fmt, ...) {
+  char buf[256];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  return write(buf);
+}
+
+void String::_fromLong(long val, unsigned char base) {
+  if (val < 0 && base == 10) {
+    _fromULong((unsigned long)(-val), base);
+    _s.insert(_s.begin(), '-');
+  } else {
+    _fromULong((unsigned long)val, base);
+  }
+}
+
+void String::_fromULong(unsigned long val, unsigned char base) {
+  static const char DIGITS[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+  if (base < 2 || base > 36)
+    base = 10;
+  char buf[8 * sizeof(long) + 1];
+  char *p = buf + sizeof(buf);
+  *--p = '\0';
+  do {
+    *--p = DIGITS[val % base];
+    val /= base;
+  } while (val);
+  _s = p;
+}
+
+void String::_fromDouble(double val, unsigned char decimals) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.*f", (int)decimals, val);
+  _s = buf;
+}
+
+/***************************************************************************
+ * I2C
+ ***************************************************************************/
+
+TwoWire Wire;
+const uint8_t TwoWire::BUFFER_LENGTH;
+
+static unsigned long _i2cBytes = 0;
+
+unsigned long NativeHAL::i2cBytes() { return _i2cBytes; }
+
+// ADS1115: register pointer, then 16-bit big-endian registers
+static const uint32_t ADS1115_CONVERSION_US[8] = {
+  125000, 62500, 31250, 15625, 7813, 4000, 2106, 1163  // 8..860 SPS
+};
+
+static struct {
+  uint8_t pointer;
+  uint16_t config;
+  uint16_t loThresh, hiThresh;
+  int16_t inputs[4];
+  int16_t conversion;
+  uint64_t convStart;
+  bool converting;  // Single-shot in progress
+} _ads1115 = { 0, 0x8583, 0x8000, 0x7fff, { 0, 0, 0, 0 }, 0, 0, false };
+
+void NativeHAL::setADS1115Input(uint8_t channel, int16_t code) {
+  if (channel < 4)
+    _ads1115.inputs[channel] = code;
+}
+
+static void _ads1115Update() {
+  bool continuous = !(_ads1115.config & 0x0100);
+  if (!continuous && !_ads1115.converting)
+    return;
+  uint32_t period = ADS1115_CONVERSION_US[(_ads1115.config >> 5) & 0x7];
+  uint64_t done = (_now - _ads1115.convStart) / period;
+  if (done == 0)
+    return;
+  uint8_t mux = (_ads1115.config >> 12) & 0x7;
+  _ads1115.conversion = (mux >= 4) ? _ads1115.inputs[mux - 4] : 0;  // Differential inputs not modeled
+  _ads1115.convStart += done * period;
+  _ads1115.converting = false;
+}
+
+static bool _ads1115Write(const uint8_t *data, uint8_t len) {
+  if (len < 1)
+    return true;
+  _ads1115.pointer = data[0] & 0x3;
+  if (len < 3)
+    return true;
+  uint16_t value = ((uint16_t)data[1] << 8) | data[2];
+  switch (_ads1115.pointer) {
+    case 1:
+      _ads1115Update();
+      _ads1115.config = value & 0x7fff;
+      if (!(value & 0x0100) || (value & 0x8000)) {
+        // Continuous, or single-shot start; either (re)starts conversion
+        _ads1115.convStart = _now;
+        _ads1115.converting = !!(value & 0x0100);
+      }
+      break;
+    case 2:
+      _ads1115.loThresh = value;
+      break;
+    case 3:
+      _ads1115.hiThresh = value;
+      break;
+  }
+  return true;
+}
+
+static uint8_t _ads1115Read(uint8_t *data, uint8_t len) {
+  _ads1115Update();
+  uint16_t value = 0;
+  switch (_ads1115.pointer) {
+    case 0: value = (uint16_t)_ads1115.conversion;  break;
+    case 1: value = _ads1115.config | (_ads1115.converting ? 0 : 0x8000);  break;
+    case 2: value = _ads1115.loThresh;  break;
+    case 3: value = _ads1115.hiThresh;  break;
+  }
+  uint8_t n = min(len, (uint8_t)2);
+  if (n > 0) data[0] = value >> 8;
+  if (n > 1) data[1] = value & 0xff;
+  return n;
+}
+
+size_t TwoWire::write(uint8_t data) {
+  if (_txLen >= BUFFER_LENGTH)
+    return 0;
+  _txBuf[_txLen++] = data;
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t quantity) {
+  size_t n = 0;
+  while (n < quantity && write(data[n]))
+    n++;
+  return n;
+}
+
+uint8_t TwoWire::endTransmission(bool sendStop) {
+  (void)sendStop;
+  _i2cBytes += 1 + _txLen;
+  if (_address != ADS1115_ADDRESS)
+    return 2;
+  _ads1115Write(_txBuf, _txLen);
+  return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, bool sendStop) {
+  (void)sendStop;
+  _rxLen = _rxPos = 0;
+  _i2cBytes += 1;
+  if (address != ADS1115_ADDRESS)
+    return 0;
+  _rxLen = _ads1115Read(_rxBuf, min(quantity, BUFFER_LENGTH));
+  _i2cBytes += _rxLen;
+  return _rxLen;
+}
+
+/***************************************************************************
+ * Network
+ ***************************************************************************/
+
+static const uint32_t WIFI_ASSOCIATE_MS = 1500;  // Simulated association time
+static const uint32_t WIFI_CONNECT_TIMEOUT_MS = 10000;  // As in the ESP32 core
+
+WiFiClass WiFi;
+MDNSResponder MDNS;
+ArduinoOTAClass ArduinoOTA;
+
+const uint8_t WiFiClass::MAX_EVENT_HANDLERS;
+
+wl_status_t WiFiClass::begin(const char *ssid, const char *passphrase) {
+  (void)ssid;  (void)passphrase;
+  _status = WL_DISCONNECTED;
+  _connectAt = _now + (uint64_t)WIFI_ASSOCIATE_MS * 1000;
+  return _status;
+}
+
+bool WiFiClass::disconnect(bool wifiOff) {
+  (void)wifiOff;
+  bool wasConnected = (_status == WL_CONNECTED);
+  _status = WL_DISCONNECTED;
+  _connectAt = 0;
+  if (wasConnected)
+    _raise(SYSTEM_EVENT_STA_DISCONNECTED);
+  return true;
+}
+
+wl_status_t WiFiClass::status() {
+  if (_status == WL_CONNECTED && !_wifiAvailable) {
+    _status = WL_CONNECTION_LOST;
+    _raise(SYSTEM_EVENT_STA_DISCONNECTED);
+  } else if (_status != WL_CONNECTED && _connectAt != 0 && _now >= _connectAt) {
+    _connectAt = 0;
+    if (_wifiAvailable) {
+      _status = WL_CONNECTED;
+      _raise(SYSTEM_EVENT_STA_CONNECTED);
+      _raise(SYSTEM_EVENT_STA_GOT_IP);
+    } else {
+      _status = WL_NO_SSID_AVAIL;
+      _raise(SYSTEM_EVENT_STA_DISCONNECTED);
+    }
+  }
+  return _status;
+}
+
+int WiFiClass::onEvent(WiFiEventCb cbEvent, system_event_id_t event) {
+  if (_nHandlers >= MAX_EVENT_HANDLERS)
+    return 0;
+  _handlers[_nHandlers].cb = cbEvent;
+  _handlers[_nHandlers].event = event;
+  return ++_nHandlers;
+}
+
+void WiFiClass::_raise(system_event_id_t event) {
+  for (uint8_t i = 0;  i < _nHandlers;  i++) {
+    if (_handlers[i].event == SYSTEM_EVENT_MAX || _handlers[i].event == event)
+      _handlers[i].cb(event);
+  }
+}
+
+uint8_t WiFiClass::waitForConnectResult() {
+  // Blocks, like the real thing, but in virtual time
+  uint64_t deadline = _now + (uint64_t)WIFI_CONNECT_TIMEOUT_MS * 1000;
+  while (_connectAt != 0 && _now < deadline) {
+    if (status() == WL_CONNECTED)
+      break;
+    delay(100);
+  }
+  return status();
+}
+
+PubSubClient::~PubSubClient() { }
+
+bool PubSubClient::connect(const char *id) {
+  (void)id;
+  if (!WiFi.isConnected() || !_brokerAvailable) {
+    _state = MQTT_CONNECT_FAILED;
+    return false;
+  }
+  _subscriptions.clear();
+  _state = MQTT_CONNECTED;
+  return true;
+}
+
+void PubSubClient::disconnect() {
+  _state = MQTT_DISCONNECTED;
+}
+
+bool PubSubClient::connected() {
+  if (_state == MQTT_CONNECTED && (!WiFi.isConnected() || !_brokerAvailable))
+    _state = MQTT_CONNECTION_LOST;
+  return _state == MQTT_CONNECTED;
+}
+
+bool PubSubClient::publish(const char *topic, const char *payload, bool retained) {
+  return publish(topic, (const uint8_t *)payload, strlen(payload), retained);
+}
+
+bool PubSubClient::publish(const char *topic, const uint8_t *payload, unsigned int plength, bool retained) {
+  (void)retained;
+  if (!connected())
+    return false;
+  if (verbose) {
+    bool text = true;
+    for (unsigned int i = 0;  i < plength && text;  i++)
+      text = isprint(payload[i]);
+    if (text) {
+      printf("MQTT> %s %.*s\n", topic, (int)plength, (const char *)payload);
+    } else {
+      printf("MQTT> %s [%u bytes]", topic, plength);
+      for (unsigned int i = 0;  i < plength;  i++)
+        printf(" %02x", payload[i]);
+      printf("\n");
+    }
+  }
+  if (onPublish)
+    onPublish(topic, payload, plength);
+  return true;
+}
+
+bool PubSubClient::subscribe(const char *topic, uint8_t qos) {
+  (void)qos;
+  if (!connected())
+    return false;
+  _subscriptions.insert(topic);
+  return true;
+}
+
+bool PubSubClient::unsubscribe(const char *topic) {
+  _subscriptions.erase(topic);
+  return connected();
+}
+
+bool PubSubClient::loop() {
+  if (!connected())
+    return false;
+  while (!_inbox.empty()) {
+    std::string topic = _inbox.front().first;
+    std::string payload = _inbox.front().second;
+    _inbox.pop_front();
+    if (!_subscriptions.count(topic))
+      continue;
+    if (verbose)
+      printf("MQTT< %s %s\n", topic.c_str(), payload.c_str());
+    if (_callback)
+      _callback(&topic[0], (uint8_t *)&payload[0], payload.size());
+  }
+  return true;
+}
+
+unsigned long NTPClient::getEpochTime() const {
+  return bootEpoch + _timeOffset + (unsigned long)(_now / 1000000);
+}
+
+/***************************************************************************
+ * Display
+ ***************************************************************************/
+
+// Fonts in the u8x8 layout, for printable ASCII; each glyph's first byte
+// is its own encoding, so drawTile() can tell which character it is
+#define _MOCK_GLYPH(c)  (c), 0, 0, 0, 0, 0, 0, 0
+#define _MOCK_GLYPHS8(c)  _MOCK_GLYPH(c), _MOCK_GLYPH(c + 1), _MOCK_GLYPH(c + 2), _MOCK_GLYPH(c + 3), \
+  _MOCK_GLYPH(c + 4), _MOCK_GLYPH(c + 5), _MOCK_GLYPH(c + 6), _MOCK_GLYPH(c + 7)
+#define _MOCK_FONT  { 0x20, 0x7e, 1, 1, \
+  _MOCK_GLYPHS8(0x20), _MOCK_GLYPHS8(0x28), _MOCK_GLYPHS8(0x30), _MOCK_GLYPHS8(0x38), \
+  _MOCK_GLYPHS8(0x40), _MOCK_GLYPHS8(0x48), _MOCK_GLYPHS8(0x50), _MOCK_GLYPHS8(0x58), \
+  _MOCK_GLYPHS8(0x60), _MOCK_GLYPHS8(0x68), _MOCK_GLYPHS8(0x70), \
+  _MOCK_GLYPH(0x78), _MOCK_GLYPH(0x79), _MOCK_GLYPH(0x7a), _MOCK_GLYPH(0x7b), \
+  _MOCK_GLYPH(0x7c), _MOCK_GLYPH(0x7d), _MOCK_GLYPH(0x7e) }
+
+const uint8_t u8x8_font_chroma48medium8_r[] = _MOCK_FONT;
+const uint8_t u8x8_font_pxplusibmcgathin_f[] = _MOCK_FONT;
+
+const uint8_t U8X8::MAX_COLS;
+const uint8_t U8X8::MAX_ROWS;
+unsigned long U8X8::_totalTilesSent = 0;
+unsigned long U8X8::_totalTransfers = 0;
+
+U8X8::U8X8(uint8_t cols, uint8_t rows)
+: _cols(min(cols, MAX_COLS)), _rows(min(rows, MAX_ROWS)), _tx(0), _ty(0), _tilesSent(0), _transfers(0) {
+  for (uint8_t y = 0;  y < MAX_ROWS;  y++) {
+    memset(_text[y], ' ', MAX_COLS);
+    _text[y][MAX_COLS] = '\0';
+  }
+}
+
+void U8X8::clearDisplay() {
+  for (uint8_t y = 0;  y < _rows;  y++)
+    clearLine(y);
+}
+
+void U8X8::clearLine(uint8_t line) {
+  if (line >= _rows)
+    return;
+  memset(_text[line], ' ', _cols);
+  _sent(_cols);
+}
+
+void U8X8::drawGlyph(uint8_t x, uint8_t y, uint8_t encoding) {
+  if (x >= _cols || y >= _rows)
+    return;
+  _text[y][x] = (encoding >= 0x20 && encoding < 0x7f) ? (char)encoding : '?';
+  _sent(1);
+}
+
+uint8_t U8X8::drawString(uint8_t x, uint8_t y, const char *s) {
+  uint8_t n = 0;
+  for (;  *s;  s++, n++)
+    drawGlyph(x + n, y, (uint8_t)*s);
+  return n;
+}
+
+// One transfer of cnt tiles; glyphs from a mock font show as their
+// character, anything else as '?'
+void U8X8::drawTile(uint8_t x, uint8_t y, uint8_t cnt, uint8_t *tile_ptr) {
+  for (uint8_t i = 0;  i < cnt && x + i < _cols;  i++) {
+    uint8_t c = tile_ptr[8 * i];
+    if (y < _rows)
+      _text[y][x + i] = (c >= 0x20 && c < 0x7f) ? (char)c : '?';
+  }
+  _sent(cnt);
+}
+
+size_t U8X8::write(uint8_t c) {
+  if (c == '\n' || c == '\r')
+    return 1;  // As with the real U8x8 print(), no line wrapping
+  drawGlyph(_tx++, _ty, c);
+  return 1;
+}
+
+/***************************************************************************
+ * Driver
+ ***************************************************************************/
+
+#ifndef NATIVEHAL_NO_MAIN
+
+extern void setup();
+extern void loop();
+
+// Firmware allocations, for onAllocate
+void *operator new(size_t size) {
+  if (onAllocate)
+    onAllocate(size);
+  void *p = malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+    "Usage: %s [-q] [-t SEC] [-s USEC] [-a PIN=CODE] [-A CH=CODE] [-d PIN=LEVEL] [-c SEC:TOPIC=PAYLOAD]\n"
+    "          [-w SEC:0|1] [-b SEC:0|1] [-m SEC:FREE/LARGEST] [-r TRACE]...\n"
+    "  -q                     quiet (no Serial or MQTT echo)\n"
+    "  -t SEC                 virtual seconds to run (default 60, or 10 past the end of any traces)\n"
+    "  -s USEC                virtual time per loop() pass (default 1000)\n"
+    "  -a PIN=CODE            analogRead() value for pin\n"
+    "  -A CH=CODE             ADS1115 (at I2C 0x48) input value for channel\n"
+    "  -d PIN=LEVEL           externally driven digital input level\n"
+    "  -c SEC:TOPIC=PAYLOAD   inject MQTT message at virtual time SEC\n"
+    "  -w SEC:0|1             WiFi access point down/up at virtual time SEC\n"
+    "  -b SEC:0|1             MQTT broker down/up at virtual time SEC\n"
+    "  -m SEC:FREE/LARGEST    heap free and largest free block, in bytes, from virtual time SEC\n"
+    "  -r TRACE               replay inputs from trace file (see Trace.h); for a ring,\n"
+    "                         give TRACE.old first\n",
+    prog);
+}
+
+struct scheduled_event_t {
+  uint64_t at;
+  char kind;  // Option letter
+  std::string topic;
+  std::string payload;
+  bool up;
+  uint8_t pin;  // Or channel
+  int value;
+  uint32_t heapFree, heapLargest;
+
+  bool operator<(const scheduled_event_t &other) const { return at < other.at; }
+};
+
+// Appends trace events, as the equivalent options at their time
+static bool _loadTrace(const char *path, std::vector<scheduled_event_t> &events) {
+  TraceReader reader;
+  if (!reader.open(path))
+    return false;
+  trace_event_t e;
+  char topic[TraceWriter::MAX_TOPIC + 1], payload[TraceWriter::MAX_PAYLOAD + 1];
+  while (reader.next(e, topic, payload)) {
+    scheduled_event_t event;
+    event.at = (uint64_t)e.ms * 1000;
+    event.pin = e.id;
+    event.value = e.value;
+    switch (e.type) {
+      case TRACE_ADC:  event.kind = 'a';  break;
+      case TRACE_ADS1115:  event.kind = 'A';  event.value = (int16_t)e.value;  break;
+      case TRACE_PIN:  event.kind = 'd';  break;
+      case TRACE_COMMAND:
+        event.kind = 'c';
+        event.topic = topic;
+        event.payload = payload;
+        break;
+      default:
+        continue;  // From a newer recorder
+    }
+    events.push_back(event);
+  }
+  return true;
+}
+
+static void _apply(const scheduled_event_t &event) {
+  switch (event.kind) {
+    case 'a':  setAnalogInput(event.pin, event.value);  break;
+    case 'A':  setADS1115Input(event.pin, event.value);  break;
+    case 'd':  setDigitalInput(event.pin, event.value);  break;
+    case 'c':  injectMessage(event.topic.c_str(), event.payload.c_str());  break;
+    case 'w':  setWiFiAvailable(event.up);  break;
+    case 'b':  setBrokerAvailable(event.up);  break;
+    case 'm':  setHeap(event.heapFree, event.heapLargest);  break;
+  }
+}
+
+int main(int argc, char **argv) {
+  double runSec = -1;
+  unsigned long tickUs = 1000;
+  std::vector<scheduled_event_t> events;
+  size_t traced = 0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "qt:s:a:A:d:c:w:b:m:r:h")) != -1) {
+    unsigned pin, value;
+    double sec;
+    char topic[128], payload[128];
+    scheduled_event_t event;
+    switch (opt) {
+      case 'q':
+        verbose = false;
+        break;
+      case 't':
+        runSec = atof(optarg);
+        break;
+      case 's':
+        tickUs = strtoul(optarg, NULL, 10);
+        break;
+      case 'a':
+        if (sscanf(optarg, "%u=%u", &pin, &value) != 2) { usage(argv[0]);  return 2; }
+        setAnalogInput(pin, value);
+        break;
+      case 'A':
+        if (sscanf(optarg, "%u=%u", &pin, &value) != 2) { usage(argv[0]);  return 2; }
+        setADS1115Input(pin, value);
+        break;
+      case 'd':
+        if (sscanf(optarg, "%u=%u", &pin, &value) != 2) { usage(argv[0]);  return 2; }
+        setDigitalInput(pin, value);
+        break;
+      case 'c':
+        if (sscanf(optarg, "%lf:%127[^=]=%127[^\n]", &sec, topic, payload) != 3) { usage(argv[0]);  return 2; }
+        event.at = (uint64_t)(sec * 1e6);
+        event.kind = opt;
+        event.topic = topic;
+        event.payload = payload;
+        events.push_back(event);
+        break;
+      case 'w':
+      case 'b':
+        if (sscanf(optarg, "%lf:%u", &sec, &value) != 2) { usage(argv[0]);  return 2; }
+        event.at = (uint64_t)(sec * 1e6);
+        event.kind = opt;
+        event.up = (value != 0);
+        events.push_back(event);
+        break;
+      case 'm':
+        if (sscanf(optarg, "%lf:%u/%u", &sec, &event.heapFree, &event.heapLargest) != 3) { usage(argv[0]);  return 2; }
+        event.at = (uint64_t)(sec * 1e6);
+        event.kind = opt;
+        events.push_back(event);
+        break;
+      case 'r': {
+        size_t before = events.size();
+        if (!_loadTrace(optarg, events)) {
+          fprintf(stderr, "%s: not a trace file\n", optarg);
+          return 1;
+        }
+        traced += events.size() - before;
+        break;
+      }
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+
+  // Trace events from different tasks may be out of order; ties keep
+  // the order given
+  std::stable_sort(events.begin(), events.end());
+  // Inputs are only recorded when read (or changed), so start each at
+  // its first recorded value, not zero
+  if (traced) {
+    std::set<std::pair<char, uint8_t> > seen;
+    for (const scheduled_event_t &event : events) {
+      if (strchr("aAd", event.kind) && seen.insert(std::make_pair(event.kind, event.pin)).second)
+        _apply(event);
+    }
+  }
+  if (runSec < 0)
+    runSec = traced ? events.back().at / 1e6 + 10 : 60.0;
+
+  struct timespec wallStart, wallEnd;
+  clock_gettime(CLOCK_MONOTONIC, &wallStart);
+
+  setup();
+  uint64_t end = (uint64_t)(runSec * 1e6);
+  unsigned long loops = 0;
+  size_t next = 0;
+  while (_now < end) {
+    for (;  next < events.size() && events[next].at <= _now;  next++)
+      _apply(events[next]);
+    WiFi.status();  // Raise any pending WiFi events
+    loop();
+    loops++;
+    advance(tickUs);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &wallEnd);
+  if (onExit)
+    onExit();
+  double wallSec = (wallEnd.tv_sec - wallStart.tv_sec) + 1e-9 * (wallEnd.tv_nsec - wallStart.tv_nsec);
+  if (traced)
+    fprintf(stderr, "NATIVE: replayed %lu trace events\n", (unsigned long)traced);
+  fprintf(stderr, "NATIVE: %.1f virtual sec, %lu loops, %.3f wall sec, %.1f ns/loop, %lu display tiles in %lu transfers, %.1f%% idle\n",
+    _now / 1e6, loops, wallSec, loops ? 1e9 * wallSec / loops : 0.0, U8X8::totalTilesSent(), U8X8::totalTransfers(),
+    _now ? 100.0 * _idle / _now : 0.0);
+  return 0;
+}
+
+#endif  // NATIVEHAL_NO_MAIN
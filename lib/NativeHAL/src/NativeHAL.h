@@ -0,0 +1,124 @@
+#ifndef __NATIVEHAL_H__
+#define __NATIVEHAL_H__
+
+// Simulation-side controls for the mock Arduino/HAL layer.  The firmware
+// itself only sees the regular Arduino APIs; these are for the host-side
+// driver (main() in NativeHAL.cpp) and any simulators hooked into it.
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace NativeHAL {
+
+static const uint8_t NUM_PINS = 40;
+
+// Verbose mode echoes Serial output and MQTT traffic to stdout
+extern bool verbose;
+
+/***************************************************************************
+ * Virtual time
+ ***************************************************************************/
+
+// Microseconds since boot; only advances via advance(), delay() and
+// delayMicroseconds() (and the main driver, once per loop() pass)
+uint64_t now();
+void advance(uint64_t us);
+// Total time spent in delay(), i.e., where the CPU could be asleep
+uint64_t idleTime();
+
+// Wall-clock time at boot (UTC seconds since epoch), used by NTPClient
+extern unsigned long bootEpoch;
+
+/***************************************************************************
+ * Pins
+ ***************************************************************************/
+
+// Raw code returned by analogRead(pin)
+void setAnalogInput(uint8_t pin, uint16_t code);
+// Externally driven level; overrides pull-ups, but not pinMode(OUTPUT).
+// Edges trigger any attached interrupt handler, before returning.
+void setDigitalInput(uint8_t pin, int level);
+// Current level, as set by either the firmware or setDigitalInput()
+int pinLevel(uint8_t pin);
+
+/***************************************************************************
+ * I2C (Wire)
+ ***************************************************************************/
+
+// ADS1115 model at address 0x48: single-ended input code for AIN0..3.
+// Conversions (single-shot or continuous) take as long as the configured
+// data rate implies; the ALERT/RDY pin is not modeled.
+static const uint8_t ADS1115_ADDRESS = 0x48;
+void setADS1115Input(uint8_t channel, int16_t code);
+
+// Bytes transferred over I2C (including address bytes)
+unsigned long i2cBytes();
+
+/***************************************************************************
+ * Network
+ ***************************************************************************/
+
+void setWiFiAvailable(bool available);
+bool wifiAvailable();
+void setBrokerAvailable(bool available);
+bool brokerAvailable();
+
+// Queue an incoming message, delivered on the next PubSubClient::loop()
+void injectMessage(const char *topic, const char *payload);
+
+// Called for every message published by the firmware (may be NULL)
+typedef void (*PublishHook)(const char *topic, const uint8_t *payload, unsigned int length);
+extern PublishHook onPublish;
+
+/***************************************************************************
+ * Memory
+ ***************************************************************************/
+
+// Heap as reported by ESP.getFreeHeap() and ESP.getMaxAllocHeap(); there
+// is no allocator behind it, so it only changes via setHeap() (and the
+// -m driver option).  ESP.getMinFreeHeap() tracks the lowest free value.
+void setHeap(uint32_t freeBytes, uint32_t largestBlock);
+
+// Called on every operator new in the firmware (may be NULL); only in
+// the driver build, as the benchmark harness counts its own
+typedef void (*AllocHook)(size_t size);
+extern AllocHook onAllocate;
+
+/***************************************************************************
+ * Reports
+ ***************************************************************************/
+
+// Inputs can also be replayed from trace files (see Trace.h, and the -r
+// driver option); each is applied at its recorded millis(), and held
+// until the next one.  The firmware can report how it fared from here.
+
+// Called once the driver is done, before its own summary (may be NULL)
+typedef void (*ExitHook)();
+extern ExitHook onExit;
+
+// Host CPU time of a piece of code (virtual time does not advance while
+// it runs, so micros() cannot measure it)
+uint64_t wallNanos();
+
+struct WallCost {
+  unsigned long count;
+  uint64_t ns;
+};
+
+// Adds the time until it goes out of scope to cost
+class WallTimer {
+public:
+  WallTimer(WallCost &cost) : _cost(cost), _start(wallNanos()) { }
+  ~WallTimer() {
+    _cost.count++;
+    _cost.ns += wallNanos() - _start;
+  }
+
+private:
+  WallCost &_cost;
+  uint64_t _start;
+};
+
+}  // namespace NativeHAL
+
+#endif /* __NATIVEHAL_H__ */
@@ -0,0 +1,33 @@
+#ifndef __NATIVEHAL_PRINT_H__
+#define __NATIVEHAL_PRINT_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+class String;
+
+// Subset of Arduino's Print; subclasses only need to implement write(uint8_t)
+class Print {
+public:
+  virtual ~Print() { }
+  virtual size_t write(uint8_t c) = 0;
+
+  size_t write(const char *str);
+  size_t write(const uint8_t *buf, size_t size);
+
+  size_t print(const char *str) { return write(str); }
+  size_t print(const String &str);
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int val, int base = 10) { return print((long)val, base); }
+  size_t print(unsigned int val, int base = 10) { return print((unsigned long)val, base); }
+  size_t print(long val, int base = 10);
+  size_t print(unsigned long val, int base = 10);
+  size_t print(double val, int digits = 2);
+
+  size_t println() { return write("\r\n"); }
+  template <typename T> size_t println(const T &val) { size_t n = print(val); return n + println(); }
+
+  size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+
+#endif /* __NATIVEHAL_PRINT_H__ */
@@ -0,0 +1,56 @@
+#ifndef __NATIVEHAL_PUBSUBCLIENT_H__
+#define __NATIVEHAL_PUBSUBCLIENT_H__
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+#include <functional>
+#include <set>
+#include <string>
+
+#define MQTT_MAX_PACKET_SIZE 256  // As PubSubClient 2.8
+
+#define MQTT_CONNECTION_TIMEOUT     -4
+#define MQTT_CONNECTION_LOST        -3
+#define MQTT_CONNECT_FAILED         -2
+#define MQTT_DISCONNECTED           -1
+#define MQTT_CONNECTED               0
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char*, uint8_t*, unsigned int)> callback
+
+// Mock client, talking to the simulated broker in NativeHAL.  Messages
+// injected via NativeHAL::injectMessage() are delivered from loop(), only
+// for subscribed topics (exact match); published messages are passed to
+// NativeHAL (see NativeHAL::onPublish).
+class PubSubClient {
+public:
+  PubSubClient(Client &client) : _state(MQTT_DISCONNECTED), _port(0) { (void)client; }
+  ~PubSubClient();
+
+  PubSubClient &setServer(const char *domain, uint16_t port) { _domain = domain;  _port = port;  return *this; }
+  PubSubClient &setCallback(MQTT_CALLBACK_SIGNATURE) { _callback = callback;  return *this; }
+  PubSubClient &setKeepAlive(uint16_t keepAlive) { (void)keepAlive;  return *this; }
+  PubSubClient &setSocketTimeout(uint16_t timeout) { (void)timeout;  return *this; }
+
+  bool connect(const char *id);
+  bool connect(const char *id, const char *user, const char *pass) { (void)user;  (void)pass;  return connect(id); }
+  void disconnect();
+  bool connected();
+  int state() { return _state; }
+
+  bool publish(const char *topic, const char *payload, bool retained = false);
+  bool publish(const char *topic, const uint8_t *payload, unsigned int plength, bool retained = false);
+  bool subscribe(const char *topic, uint8_t qos = 0);
+  bool unsubscribe(const char *topic);
+
+  bool loop();
+
+private:
+  std::function<void(char*, uint8_t*, unsigned int)> _callback;
+  std::set<std::string> _subscriptions;
+  int _state;
+  std::string _domain;
+  uint16_t _port;
+};
+
+#endif /* __NATIVEHAL_PUBSUBCLIENT_H__ */
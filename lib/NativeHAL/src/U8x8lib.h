@@ -0,0 +1,67 @@
+#ifndef __NATIVEHAL_U8X8LIB_H__
+#define __NATIVEHAL_U8X8LIB_H__
+
+#include <Arduino.h>
+
+#define U8X8_PIN_NONE 255
+
+extern const uint8_t u8x8_font_chroma48medium8_r[];
+extern const uint8_t u8x8_font_pxplusibmcgathin_f[];
+
+// Character-cell model of the display; keeps the text that would be on
+// screen, and counts 8x8 tiles and the I2C transfers they took (one per
+// drawGlyph(), drawTile() or clearLine() on the real thing)
+class U8X8 : public Print {
+public:
+  U8X8(uint8_t cols, uint8_t rows);
+  virtual ~U8X8() { }
+
+  bool begin() { clearDisplay();  return true; }
+  void setFlipMode(uint8_t mode) { (void)mode; }
+  void setPowerSave(uint8_t is_enable) { (void)is_enable; }
+  void setFont(const uint8_t *font) { (void)font; }
+
+  uint8_t getCols() const { return _cols; }
+  uint8_t getRows() const { return _rows; }
+
+  void setCursor(uint8_t x, uint8_t y) { _tx = x;  _ty = y; }
+  void clearDisplay();
+  void clearLine(uint8_t line);
+  void drawGlyph(uint8_t x, uint8_t y, uint8_t encoding);
+  uint8_t drawString(uint8_t x, uint8_t y, const char *s);
+  void drawTile(uint8_t x, uint8_t y, uint8_t cnt, uint8_t *tile_ptr);
+
+  virtual size_t write(uint8_t c) override;
+  using Print::write;
+
+  // Mock-only: screen contents and transfer count
+  const char *line(uint8_t y) const { return _text[y]; }
+  unsigned long tilesSent() const { return _tilesSent; }
+  unsigned long transfers() const { return _transfers; }
+  static unsigned long totalTilesSent() { return _totalTilesSent; }  // All displays
+  static unsigned long totalTransfers() { return _totalTransfers; }
+
+private:
+  static const uint8_t MAX_COLS = 16;
+  static const uint8_t MAX_ROWS = 8;
+
+  uint8_t _cols, _rows;
+  uint8_t _tx, _ty;
+  char _text[MAX_ROWS][MAX_COLS + 1];
+  unsigned long _tilesSent, _transfers;
+  static unsigned long _totalTilesSent, _totalTransfers;
+
+  // One transfer
+  inline void _sent(unsigned long tiles) {
+    _tilesSent += tiles;  _totalTilesSent += tiles;
+    _transfers++;  _totalTransfers++;
+  }
+};
+
+class U8X8_SSD1306_128X32_UNIVISION_HW_I2C : public U8X8 {
+public:
+  U8X8_SSD1306_128X32_UNIVISION_HW_I2C(uint8_t reset = U8X8_PIN_NONE, uint8_t clock = U8X8_PIN_NONE, uint8_t data = U8X8_PIN_NONE)
+  : U8X8(16, 4) { (void)reset;  (void)clock;  (void)data; }
+};
+
+#endif /* __NATIVEHAL_U8X8LIB_H__ */
@@ -0,0 +1,53 @@
+#ifndef __NATIVEHAL_WSTRING_H__
+#define __NATIVEHAL_WSTRING_H__
+
+#include <stdlib.h>
+#include <string>
+
+// Subset of Arduino's String, backed by std::string (so heap behaviour
+// is similar: reallocations on growth)
+class String {
+public:
+  String(const char *str = "") : _s(str ? str : "") { }
+  String(const std::string &str) : _s(str) { }
+  explicit String(char c) : _s(1, c) { }
+  explicit String(int val, unsigned char base = 10) { _fromLong(val, base); }
+  explicit String(unsigned int val, unsigned char base = 10) { _fromULong(val, base); }
+  explicit String(long val, unsigned char base = 10) { _fromLong(val, base); }
+  explicit String(unsigned long val, unsigned char base = 10) { _fromULong(val, base); }
+  explicit String(float val, unsigned char decimals = 2) { _fromDouble(val, decimals); }
+  explicit String(double val, unsigned char decimals = 2) { _fromDouble(val, decimals); }
+
+  inline const char *c_str() const { return _s.c_str(); }
+  inline unsigned int length() const { return _s.length(); }
+  inline bool reserve(unsigned int size) { _s.reserve(size); return true; }
+
+  inline bool concat(char c) { _s.push_back(c); return true; }
+  inline bool concat(const char *str) { _s.append(str); return true; }
+  inline bool concat(const String &str) { _s.append(str._s); return true; }
+
+  inline String &operator+=(char c) { concat(c); return *this; }
+  inline String &operator+=(const char *str) { concat(str); return *this; }
+  inline String &operator+=(const String &str) { concat(str); return *this; }
+
+  inline bool operator==(const char *str) const { return _s == str; }
+  inline bool operator==(const String &str) const { return _s == str._s; }
+  inline bool operator!=(const char *str) const { return _s != str; }
+  inline bool operator!=(const String &str) const { return _s != str._s; }
+
+  inline float toFloat() const { return (float)atof(_s.c_str()); }
+  inline long toInt() const { return atol(_s.c_str()); }
+
+  friend String operator+(const String &lhs, const String &rhs) { return String(lhs._s + rhs._s); }
+  friend String operator+(const char *lhs, const String &rhs) { return String(lhs + rhs._s); }
+  friend String operator+(const String &lhs, const char *rhs) { return String(lhs._s + rhs); }
+
+private:
+  std::string _s;
+
+  void _fromLong(long val, unsigned char base);
+  void _fromULong(unsigned long val, unsigned char base);
+  void _fromDouble(double val, unsigned char decimals);
+};
+
+#endif /* __NATIVEHAL_WSTRING_H__ */
@@ -0,0 +1,70 @@
+#ifndef __NATIVEHAL_WIFI_H__
+#define __NATIVEHAL_WIFI_H__
+
+#include <Arduino.h>
+#include "IPAddress.h"
+
+typedef enum {
+  WL_IDLE_STATUS = 0, WL_NO_SSID_AVAIL = 1, WL_SCAN_COMPLETED = 2, WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4, WL_CONNECTION_LOST = 5, WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } wifi_mode_t;
+
+// Station events only, as in the ESP32 core's (IDF 3.x) event ids
+typedef enum {
+  SYSTEM_EVENT_STA_START = 2, SYSTEM_EVENT_STA_STOP = 3,
+  SYSTEM_EVENT_STA_CONNECTED = 4, SYSTEM_EVENT_STA_DISCONNECTED = 5,
+  SYSTEM_EVENT_STA_GOT_IP = 7, SYSTEM_EVENT_STA_LOST_IP = 8,
+  SYSTEM_EVENT_MAX = 26
+} system_event_id_t;
+typedef system_event_id_t WiFiEvent_t;
+typedef void (*WiFiEventCb)(system_event_id_t event);
+
+// Base for network clients; the mock does not move any actual bytes
+class Client { };
+class UDP { };
+
+class WiFiClient : public Client { };
+
+// Connection succeeds iff the simulated access point is available; see
+// NativeHAL::setWiFiAvailable().  Events are raised (synchronously) from
+// status(), which the driver also polls once per loop() pass.
+class WiFiClass {
+public:
+  static const uint8_t MAX_EVENT_HANDLERS = 4;
+
+  WiFiClass() : _status(WL_DISCONNECTED), _connectAt(0), _nHandlers(0) { }
+
+  void persistent(bool persistent) { (void)persistent; }
+  bool setAutoConnect(bool autoConnect) { (void)autoConnect; return true; }
+  bool setAutoReconnect(bool autoReconnect) { (void)autoReconnect; return true; }
+  bool mode(wifi_mode_t mode) { (void)mode; return true; }
+
+  wl_status_t begin(const char *ssid, const char *passphrase = NULL);
+  bool disconnect(bool wifiOff = false);
+  uint8_t waitForConnectResult();
+
+  wl_status_t status();
+  bool isConnected() { return status() == WL_CONNECTED; }
+  IPAddress localIP() { return isConnected() ? IPAddress(192, 168, 0, 42) : IPAddress(); }
+  bool setSleep(bool enable) { (void)enable;  return true; }
+
+  int onEvent(WiFiEventCb cbEvent, system_event_id_t event = SYSTEM_EVENT_MAX);
+
+private:
+  wl_status_t _status;
+  uint64_t _connectAt;  // Virtual time when association attempt completes
+
+  struct {
+    WiFiEventCb cb;
+    system_event_id_t event;
+  } _handlers[MAX_EVENT_HANDLERS];
+  uint8_t _nHandlers;
+
+  void _raise(system_event_id_t event);
+};
+
+extern WiFiClass WiFi;
+
+#endif /* __NATIVEHAL_WIFI_H__ */
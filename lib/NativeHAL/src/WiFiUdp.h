@@ -0,0 +1,8 @@
+#ifndef __NATIVEHAL_WIFIUDP_H__
+#define __NATIVEHAL_WIFIUDP_H__
+
+#include <WiFi.h>
+
+class WiFiUDP : public UDP { };
+
+#endif /* __NATIVEHAL_WIFIUDP_H__ */
@@ -0,0 +1,36 @@
+#ifndef __NATIVEHAL_WIRE_H__
+#define __NATIVEHAL_WIRE_H__
+
+#include <Arduino.h>
+
+// I2C master; transactions go to device models in NativeHAL.cpp (see
+// NativeHAL.h), and are NACKed for any other address
+class TwoWire {
+public:
+  static const uint8_t BUFFER_LENGTH = 32;
+
+  TwoWire() : _address(0), _txLen(0), _rxLen(0), _rxPos(0) { }
+
+  bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0) { (void)sda;  (void)scl;  (void)frequency;  return true; }
+  void setClock(uint32_t frequency) { (void)frequency; }
+
+  void beginTransmission(uint8_t address) { _address = address;  _txLen = 0; }
+  size_t write(uint8_t data);
+  size_t write(const uint8_t *data, size_t quantity);
+  uint8_t endTransmission(bool sendStop = true);  // 0 on success, 2 on address NACK
+
+  uint8_t requestFrom(uint8_t address, uint8_t quantity, bool sendStop = true);
+  int available() { return _rxLen - _rxPos; }
+  int read() { return (_rxPos < _rxLen) ? _rxBuf[_rxPos++] : -1; }
+
+private:
+  uint8_t _address;
+  uint8_t _txBuf[BUFFER_LENGTH];
+  uint8_t _txLen;
+  uint8_t _rxBuf[BUFFER_LENGTH];
+  uint8_t _rxLen, _rxPos;
+};
+
+extern TwoWire Wire;
+
+#endif /* __NATIVEHAL_WIRE_H__ */
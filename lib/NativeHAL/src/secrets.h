@@ -0,0 +1,5 @@
+// Placeholder credentials for native builds; a project-level
+// include/secrets.h takes precedence
+#define SECRET_WIFI_SSID      "native"
+#define SECRET_WIFI_PASSWORD  "native"
+#define SECRET_OTA_PASSWORD   "native"
@@ -0,0 +1,53 @@
+#ifndef __SPSCQUEUE_H__
+#define __SPSCQUEUE_H__
+
+#include <stdint.h>
+#include <atomic>
+
+// Lock-free ring buffer for exactly one producer and one consumer (each
+// may be a task or an ISR).  Holds up to N-1 elements; N must be a power
+// of two.  Each index is written by one side only, and published with
+// release/acquire ordering, so neither side ever blocks or takes a lock.
+template <typename T, uint32_t N>
+class SPSCQueue {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "SPSCQueue size must be a power of two");
+
+public:
+  SPSCQueue() : _head(0), _tail(0) { }
+
+  // Producer side; returns false (and drops item) if full
+  bool push(const T& item) {
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    uint32_t next = (head + 1) & (N - 1);
+    if (next == _tail.load(std::memory_order_acquire))
+      return false;
+    _buf[head] = item;
+    _head.store(next, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side; returns false if empty
+  bool pop(T& item) {
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail == _head.load(std::memory_order_acquire))
+      return false;
+    item = _buf[tail];
+    _tail.store((tail + 1) & (N - 1), std::memory_order_release);
+    return true;
+  }
+
+  // Approximate, when called from either side while the other is active
+  inline bool empty() const {
+    return _tail.load(std::memory_order_acquire) == _head.load(std::memory_order_acquire);
+  }
+  inline uint32_t size() const {
+    return (_head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire)) & (N - 1);
+  }
+
+private:
+  T _buf[N];
+  std::atomic<uint32_t> _head;  // Next slot to write (producer)
+  std::atomic<uint32_t> _tail;  // Next slot to read (consumer)
+};
+
+#endif /* __SPSCQUEUE_H__ */
@@ -0,0 +1,178 @@
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include <Arduino.h>
+
+/***************************************************************************
+ * 
+ ***************************************************************************/
+
+typedef void (*job_fn_t)();
+typedef int8_t job_id_t;  // Negative if invalid
+
+// Cooperative scheduler for up to N jobs, with millis() deadlines kept
+// in a binary min-heap.  Jobs are registered once, via add() (usually in
+// setup), and then armed with start() and disarmed with stop(), any
+// number of times; nothing is allocated after construction.  Periodic
+// jobs re-arm themselves, one-shot jobs (period 0) run once per start().
+// A job with a NULL function is just a timer, e.g. for a lockout period
+// (see pending()).
+//
+// run() calls every job that is due, and returns the time until the next
+// deadline, i.e., how long the caller may idle.  Jobs may start or stop
+// any job (including themselves) while running.  Deadlines must be less
+// than ~24 days away (millis() wraparound).
+//
+// Not thread-safe; use one scheduler per task.
+template <uint8_t N>
+class Scheduler {
+  static_assert(N > 0 && N <= 127, "Scheduler capacity must fit job_id_t");
+
+public:
+  static const uint32_t NEVER = UINT32_MAX;  // From run(), if nothing is armed
+
+  Scheduler() : _nJobs(0), _nHeap(0), _running(-1), _runs(0) { }
+
+  // Register job; period in msec (0 for one-shot).  Returns -1 if full.
+  job_id_t add(job_fn_t fn, uint32_t periodMs = 0) {
+    if (_nJobs >= N)
+      return -1;
+    job_t &job = _jobs[_nJobs];
+    job.fn = fn;
+    job.period = periodMs;
+    job.pos = -1;
+    return _nJobs++;
+  }
+
+  // Shorthand for add() and start()
+  job_id_t every(uint32_t periodMs, job_fn_t fn, uint32_t delayMs = 0, unsigned long now = millis()) {
+    job_id_t id = add(fn, periodMs);
+    if (id >= 0)
+      start(id, delayMs, now);
+    return id;
+  }
+
+  // (Re)arm job to run delayMs from now; periodic jobs then keep running
+  // every period thereafter
+  void start(job_id_t id, uint32_t delayMs = 0, unsigned long now = millis()) {
+    job_t &job = _jobs[id];
+    job.deadline = now + delayMs;
+    if (job.pos < 0) {
+      job.pos = _nHeap;
+      _heap[_nHeap++] = id;
+      _siftUp(job.pos);
+    } else {
+      _siftUp(job.pos);
+      _siftDown(_jobs[id].pos);
+    }
+  }
+
+  // Disarm job; no-op if not armed
+  void stop(job_id_t id) {
+    job_t &job = _jobs[id];
+    if (job.pos < 0)
+      return;
+    int8_t pos = job.pos;
+    job.pos = -1;
+    if (pos != --_nHeap) {
+      _place(pos, _heap[_nHeap]);
+      _siftUp(pos);
+      _siftDown(_jobs[_heap[pos]].pos);
+    }
+  }
+
+  // True if job is armed (or currently running, and has re-armed itself)
+  inline bool pending(job_id_t id) const { return _jobs[id].pos >= 0; }
+
+  // Run all jobs that are due; returns msec until the next deadline
+  uint32_t run(unsigned long now = millis()) {
+    while (_nHeap > 0) {
+      job_id_t id = _heap[0];
+      job_t &job = _jobs[id];
+      if ((long)(now - job.deadline) < 0)
+        break;
+      // Re-arm (or disarm) before calling, so the job may override either
+      if (job.period > 0) {
+        unsigned long next = job.deadline + job.period;
+        // If more than a whole period late, skip missed runs instead of
+        // bursting to catch up
+        start(id, ((long)(next - now) > 0) ? next - now : job.period, now);
+      } else {
+        stop(id);
+      }
+      _runs++;
+      if (job.fn) {
+        _running = id;
+        job.fn();
+        _running = -1;
+      }
+    }
+    return idle(now);
+  }
+
+  // Msec until the next deadline (0 if overdue, NEVER if nothing armed)
+  uint32_t idle(unsigned long now = millis()) const {
+    if (_nHeap == 0)
+      return NEVER;
+    long wait = (long)(_jobs[_heap[0]].deadline - now);
+    return (wait > 0) ? (uint32_t)wait : 0;
+  }
+
+  // Job currently being run, or -1
+  inline job_id_t running() const { return _running; }
+  // Total job runs so far (including timers)
+  inline uint32_t runs() const { return _runs; }
+
+private:
+  typedef struct {
+    job_fn_t fn;
+    uint32_t period;
+    unsigned long deadline;
+    int8_t pos;  // Index in _heap, or -1 if not armed
+  } job_t;
+
+  job_t _jobs[N];
+  job_id_t _heap[N];
+  uint8_t _nJobs, _nHeap;
+  job_id_t _running;
+  uint32_t _runs;
+
+  inline bool _before(job_id_t a, job_id_t b) const {
+    return (long)(_jobs[a].deadline - _jobs[b].deadline) < 0;
+  }
+
+  inline void _place(int pos, job_id_t id) {
+    _heap[pos] = id;
+    _jobs[id].pos = pos;
+  }
+
+  void _siftUp(int pos) {
+    job_id_t id = _heap[pos];
+    while (pos > 0) {
+      int parent = (pos - 1) / 2;
+      if (!_before(id, _heap[parent]))
+        break;
+      _place(pos, _heap[parent]);
+      pos = parent;
+    }
+    _place(pos, id);
+  }
+
+  void _siftDown(int pos) {
+    job_id_t id = _heap[pos];
+    for (;;) {
+      int child = 2 * pos + 1;
+      if (child >= _nHeap)
+        break;
+      if (child + 1 < _nHeap && _before(_heap[child + 1], _heap[child]))
+        child++;
+      if (!_before(_heap[child], id))
+        break;
+      _place(pos, _heap[child]);
+      pos = child;
+    }
+    _place(pos, id);
+  }
+};
+
+#endif /* __SCHEDULER_H__ */
@@ -0,0 +1,128 @@
+#ifndef __TEXTSCREEN_H__
+#define __TEXTSCREEN_H__
+
+#include <Arduino.h>
+#include <U8x8lib.h>
+
+#include <stdarg.h>
+
+/***************************************************************************
+ * 
+ ***************************************************************************/
+
+// COLS x ROWS character framebuffer, in front of a U8x8 display.  All
+// drawing happens in memory; flush() then compares against what is
+// already on the display, and sends only the tiles (i.e., character
+// cells) that changed.  Each run of changed cells in a row goes out as
+// one drawTile() (one I2C transfer), with glyphs rendered from the font
+// here, so e.g. rewriting a line with one changed digit costs one tile,
+// and rewriting a whole line still costs one transfer.
+//
+// The font must be the one set on the display, with 1x1-tile glyphs
+// (any u8x8 font without a "2x2"/"1x2" variant); without one, each
+// changed cell is sent with its own drawGlyph().
+//
+// Not thread-safe; draw and flush from a single task.
+template <uint8_t COLS, uint8_t ROWS>
+class TextScreen {
+public:
+  TextScreen(const uint8_t *font = NULL) : _font(font) {
+    clear();
+    invalidate();
+  }
+
+  inline void setFont(const uint8_t *font) { _font = font; }
+
+  void clear() {
+    memset(_frame, ' ', sizeof(_frame));
+  }
+
+  void clearLine(uint8_t row) {
+    if (row < ROWS)
+      memset(_frame[row], ' ', COLS);
+  }
+
+  // Write text at (col, row), clipped at the right edge (no wrapping)
+  void print(uint8_t col, uint8_t row, const char *str) {
+    if (row >= ROWS)
+      return;
+    for (;  *str && col < COLS;  str++, col++)
+      _frame[row][col] = *str;
+  }
+
+  void printf(uint8_t col, uint8_t row, const char *fmt, ...) __attribute__((format(printf, 4, 5))) {
+    char buf[COLS + 1];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    print(col, row, buf);
+  }
+
+  // Clear the line, and write text centered on it
+  void printCentered(uint8_t row, const char *str) {
+    clearLine(row);
+    size_t len = strlen(str);
+    print((len < COLS) ? (COLS - len)/2 : 0, row, str);
+  }
+
+  // Forget display contents, so next flush() redraws everything
+  void invalidate() {
+    memset(_shown, 0, sizeof(_shown));
+  }
+
+  // Send changed tiles to the display; returns number of tiles sent
+  unsigned flush(U8X8 &display) {
+    unsigned sent = 0;
+    for (uint8_t row = 0;  row < ROWS;  row++) {
+      if (!memcmp(_frame[row], _shown[row], COLS))
+        continue;
+      uint8_t col = 0;
+      while (col < COLS) {
+        if (_frame[row][col] == _shown[row][col]) {
+          col++;
+          continue;
+        }
+        uint8_t start = col;
+        for (;  col < COLS && _frame[row][col] != _shown[row][col];  col++)
+          _shown[row][col] = _frame[row][col];
+        _send(display, start, row, col - start);
+        sent += col - start;
+      }
+    }
+    return sent;
+  }
+
+private:
+  const uint8_t *_font;
+  char _frame[ROWS][COLS];  // What we want on screen
+  char _shown[ROWS][COLS];  // What is on screen
+  uint8_t _tiles[COLS * 8];  // One row's worth, for drawTile()
+
+  // Cells [col, col + n) of row, from _shown
+  void _send(U8X8 &display, uint8_t col, uint8_t row, uint8_t n) {
+    if (!_font) {
+      for (uint8_t i = 0;  i < n;  i++)
+        display.drawGlyph(col + i, row, (uint8_t)_shown[row][col + i]);
+      return;
+    }
+    for (uint8_t i = 0;  i < n;  i++)
+      _glyph((uint8_t)_shown[row][col + i], _tiles + 8 * i);
+    display.drawTile(col, row, n, _tiles);
+  }
+
+  // Glyph bitmap, as u8x8 itself looks it up: a 4-byte header (first and
+  // last encoding, tile width and height), then 8 bytes per tile
+  void _glyph(uint8_t encoding, uint8_t *tile) const {
+    uint8_t first = pgm_read_byte(_font), last = pgm_read_byte(_font + 1);
+    if (encoding < first || encoding > last) {
+      memset(tile, 0, 8);
+      return;
+    }
+    const uint8_t *p = _font + 4 + 8 * (encoding - first);
+    for (uint8_t i = 0;  i < 8;  i++)
+      tile[i] = pgm_read_byte(p + i);
+  }
+};
+
+#endif /* __TEXTSCREEN_H__ */
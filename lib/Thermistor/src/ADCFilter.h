@@ -0,0 +1,185 @@
+#ifndef __ADCFILTER_H__
+#define __ADCFILTER_H__
+
+#include <Arduino.h>
+
+/***************************************************************************
+ * 
+ ***************************************************************************/
+
+// Pluggable filter stage for BasicADCPort (see setFilter()), which
+// replaces the plain average of nSamples readings.  reset() is called at
+// the start of each measurement, then add() for every sample, until
+// complete() says enough samples have been taken; result() is then the
+// measurement.  Filters may keep state across measurements.
+//
+// Statistics are computed in float, whatever T is, since ADC noise
+// variances are far below Q16.16 resolution.
+template <typename T>
+class ADCFilter {
+public:
+  virtual ~ADCFilter() { }
+  virtual void reset() = 0;
+  virtual void add(T sample) = 0;
+  // count samples taken so far; nSamples is the port's setting
+  virtual bool complete(uint8_t count, uint8_t nSamples) const { return count >= nSamples; }
+  virtual T result() = 0;
+};
+
+// Median of nSamples (up to MAX) readings; rejects isolated spikes
+template <typename T, uint8_t MAX = 9>
+class MedianFilter : public ADCFilter<T> {
+public:
+  MedianFilter() : _count(0) { }
+
+  virtual void reset() override { _count = 0; }
+  virtual void add(T sample) override {
+    if (_count < MAX)
+      _insert(sample);
+  }
+  virtual bool complete(uint8_t count, uint8_t nSamples) const override {
+    return count >= min(nSamples, MAX);
+  }
+  virtual T result() override {
+    if (_count == 0)
+      return T(0);
+    if (_count & 1)
+      return _sorted[_count/2];
+    return T((float(_sorted[_count/2 - 1]) + float(_sorted[_count/2])) / 2);
+  }
+
+protected:
+  T _sorted[MAX];
+  uint8_t _count;
+
+  void _insert(T sample) {
+    uint8_t i = _count++;
+    for (;  i > 0 && _sorted[i-1] > sample;  i--)
+      _sorted[i] = _sorted[i-1];
+    _sorted[i] = sample;
+  }
+};
+
+// Takes between minSamples and the port's nSamples readings: just enough
+// for the standard error of the mean to be within tolerance, given the
+// noise variance (estimated over recent measurements, and from the
+// current one).  With three or more samples (i.e., when noise is high),
+// the median is used instead of the mean, so a spike both triggers extra
+// samples and gets rejected.
+template <typename T, uint8_t MAX = 9>
+class AdaptiveFilter : public MedianFilter<T, MAX> {
+public:
+  static constexpr float DEFAULT_SMOOTHING = 0.2;  // Weight of latest variance estimate
+
+  AdaptiveFilter(float tolerance, uint8_t minSamples = 2, float smoothing = DEFAULT_SMOOTHING)
+  : _tol2(tolerance * tolerance), _minSamples(max(minSamples, (uint8_t)2)), _smoothing(smoothing),
+    _noiseVar(-1), _sum(0), _sumSq(0) { }
+
+  virtual void reset() override {
+    MedianFilter<T, MAX>::reset();
+    _sum = _sumSq = 0;
+  }
+
+  virtual void add(T sample) override {
+    MedianFilter<T, MAX>::add(sample);
+    float x = float(sample);
+    _sum += x;
+    _sumSq += x * x;
+  }
+
+  virtual bool complete(uint8_t count, uint8_t nSamples) const override {
+    if (count >= min(nSamples, MAX))
+      return true;
+    if (count < _minSamples)
+      return false;
+    float var = max(_variance(), _noiseVar);
+    return var <= _tol2 * count;
+  }
+
+  virtual T result() override {
+    uint8_t n = this->_count;
+    if (n >= 2) {
+      float var = _variance();
+      _noiseVar = (_noiseVar < 0) ? var : _smoothing * var + (1 - _smoothing) * _noiseVar;
+    }
+    if (n >= 3)
+      return MedianFilter<T, MAX>::result();
+    return (n > 0) ? T(_sum / n) : T(0);
+  }
+
+  inline float noiseVariance() const { return _noiseVar; }
+
+private:
+  float _tol2;
+  uint8_t _minSamples;
+  float _smoothing;
+  float _noiseVar;  // Smoothed; negative until first estimate
+  float _sum, _sumSq;
+
+  inline float _variance() const {
+    uint8_t n = this->_count;
+    if (n < 2)
+      return 0;
+    float mean = _sum / n;
+    return max((_sumSq - n * mean * mean) / (n - 1), 0.0f);
+  }
+};
+
+// Scalar Kalman filter, with a random-walk model of the reading: process
+// noise q is added once per measurement (i.e., per request(), so it
+// should match the request interval), and r is the variance of a single
+// sample.  State carries over across measurements, so this replaces the
+// thermistor's exponential smoothing (use lambda 1.0 with it).  Samples
+// more than `gate` standard deviations from the prediction are ignored,
+// unless that happens for all samples of GATE_RESET measurements in a
+// row (i.e., it is a real step change, not a spike).
+template <typename T>
+class KalmanFilter : public ADCFilter<T> {
+public:
+  static const uint8_t GATE_RESET = 3;
+
+  KalmanFilter(float q, float r, float gate = 4.0)
+  : _q(q), _r(r), _gate2(gate * gate), _x(0), _p(-1), _accepted(0), _rejectedRuns(0) { }
+
+  virtual void reset() override {
+    if (_p >= 0)
+      _p += _q;
+    if (_accepted > 0)
+      _rejectedRuns = 0;  // Previous measurement used some samples; the run is over
+    else if (_p >= 0)
+      _rejectedRuns++;
+    _accepted = 0;
+  }
+
+  virtual void add(T sample) override {
+    float z = float(sample);
+    if (_p < 0 || _rejectedRuns >= GATE_RESET) {
+      // (Re)initialize on first sample, or after a persistent change
+      _x = z;
+      _p = _r;
+      _rejectedRuns = 0;
+      _accepted++;
+      return;
+    }
+    float innovation = z - _x;
+    float s = _p + _r;
+    if (innovation * innovation > _gate2 * s)
+      return;  // Outlier
+    float k = _p / s;
+    _x += k * innovation;
+    _p *= (1 - k);
+    _accepted++;
+  }
+
+  virtual T result() override { return T(_x); }
+
+  inline float variance() const { return _p; }
+
+private:
+  float _q, _r, _gate2;
+  float _x, _p;  // Estimate and its variance; _p < 0 if none yet
+  uint8_t _accepted;  // Samples used, in current measurement
+  uint8_t _rejectedRuns;  // Consecutive measurements with no samples used
+};
+
+#endif /* __ADCFILTER_H__ */
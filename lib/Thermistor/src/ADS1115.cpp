@@ -0,0 +1,154 @@
+#include "ADS1115.h"
+
+// Registers
+static const uint8_t REG_CONVERSION = 0x00;
+static const uint8_t REG_CONFIG = 0x01;
+static const uint8_t REG_LO_THRESH = 0x02;
+static const uint8_t REG_HI_THRESH = 0x03;
+
+// Config register fields
+static const uint16_t CONFIG_MUX_SINGLE_0 = 0x4000;  // AINx vs GND is 0x4000 + (x << 12)
+static const uint8_t CONFIG_PGA_SHIFT = 9;
+static const uint16_t CONFIG_MODE_CONTINUOUS = 0x0000;
+static const uint8_t CONFIG_DR_SHIFT = 5;
+static const uint16_t CONFIG_COMP_QUE_1 = 0x0000;  // Assert ALERT after one conversion
+static const uint16_t CONFIG_COMP_QUE_DISABLE = 0x0003;
+
+// Conversion time, by data rate; a little extra, when polling, for the
+// chip's oscillator tolerance (+/-10%)
+static const uint32_t CONVERSION_US[8] = {
+  125000, 62500, 31250, 15625, 7813, 4000, 2106, 1163
+};
+
+bool ADS1115Continuous::addChannel(uint8_t channel) {
+  if (_nChannels >= MAX_CHANNELS || channel > 3 || _find(channel))
+    return false;
+  channel_t &c = _channels[_nChannels++];
+  c.ain = channel;
+  c.head = c.count = 0;
+  memset(c.buffer, 0, sizeof(c.buffer));
+  return true;
+}
+
+bool ADS1115Continuous::begin(ads1115_pga_t pga, ads1115_rate_t rate, int rdyPin) {
+  _rdyPin = rdyPin;
+  _periodUs = CONVERSION_US[rate];
+  _config = CONFIG_MODE_CONTINUOUS | ((uint16_t)pga << CONFIG_PGA_SHIFT) | ((uint16_t)rate << CONFIG_DR_SHIFT);
+  if (_rdyPin >= 0) {
+    // Hi_thresh MSB set and Lo_thresh MSB clear turns ALERT into a
+    // conversion-ready signal, pulsing low after every conversion
+    if (!_writeRegister(REG_HI_THRESH, 0x8000) || !_writeRegister(REG_LO_THRESH, 0x0000))
+      return false;
+    _config |= CONFIG_COMP_QUE_1;
+    pinMode(_rdyPin, INPUT_PULLUP);
+    attachInterruptArg(digitalPinToInterrupt(_rdyPin), _onReady, this, FALLING);
+  } else {
+    _config |= CONFIG_COMP_QUE_DISABLE;
+  }
+  _current = 0;
+  if (_nChannels == 0)
+    return true;
+  _startChannel(micros());
+  uint16_t check;
+  return _readRegister(REG_CONFIG, check);
+}
+
+void IRAM_ATTR ADS1115Continuous::_onReady(void *arg) {
+  ((ADS1115Continuous *)arg)->_rdy = true;
+}
+
+bool ADS1115Continuous::update(uint32_t nowUs) {
+  if (_nChannels == 0)
+    return false;
+  if (_rdyPin >= 0) {
+    if (!_rdy)
+      return false;
+    _rdy = false;
+  } else if (nowUs - _convStart < _periodUs + _periodUs/8) {
+    return false;
+  }
+
+  uint16_t raw;
+  if (!_readRegister(REG_CONVERSION, raw)) {
+    _startChannel(nowUs);  // Start over, in case the chip was reset
+    return false;
+  }
+  if (_discard) {
+    _discard = false;
+    _convStart = nowUs;
+    return false;
+  }
+
+  channel_t &c = _channels[_current];
+  if (c.count == BUFFER_SIZE) {
+    c.head = (c.head + 1) % BUFFER_SIZE;
+    c.count--;
+    _overruns++;
+  }
+  c.buffer[(c.head + c.count++) % BUFFER_SIZE] = (int16_t)raw;
+  _conversions++;
+
+  _current = (_current + 1) % _nChannels;
+  if (_nChannels > 1) {
+    _startChannel(nowUs);
+  } else {
+    _convStart = nowUs;
+  }
+  return true;
+}
+
+bool ADS1115Continuous::pop(uint8_t channel, int16_t &value) {
+  channel_t *c = _find(channel);
+  if (!c || c->count == 0)
+    return false;
+  value = c->buffer[c->head];
+  c->head = (c->head + 1) % BUFFER_SIZE;
+  c->count--;
+  return true;
+}
+
+int16_t ADS1115Continuous::latest(uint8_t channel) const {
+  const channel_t *c = _find(channel);
+  if (!c)
+    return 0;
+  return c->buffer[(c->head + c->count + BUFFER_SIZE - 1) % BUFFER_SIZE];
+}
+
+ADS1115Continuous::channel_t *ADS1115Continuous::_find(uint8_t ain) {
+  for (uint8_t i = 0;  i < _nChannels;  i++)
+    if (_channels[i].ain == ain)
+      return &_channels[i];
+  return NULL;
+}
+
+const ADS1115Continuous::channel_t *ADS1115Continuous::_find(uint8_t ain) const {
+  return const_cast<ADS1115Continuous *>(this)->_find(ain);
+}
+
+void ADS1115Continuous::_startChannel(uint32_t nowUs) {
+  uint16_t mux = CONFIG_MUX_SINGLE_0 + ((uint16_t)_channels[_current].ain << 12);
+  _writeRegister(REG_CONFIG, _config | mux);
+  _convStart = nowUs;
+  _rdy = false;
+  _discard = true;
+}
+
+bool ADS1115Continuous::_writeRegister(uint8_t reg, uint16_t value) {
+  _wire.beginTransmission(_address);
+  _wire.write(reg);
+  _wire.write((uint8_t)(value >> 8));
+  _wire.write((uint8_t)(value & 0xff));
+  return _wire.endTransmission() == 0;
+}
+
+bool ADS1115Continuous::_readRegister(uint8_t reg, uint16_t &value) {
+  _wire.beginTransmission(_address);
+  _wire.write(reg);
+  if (_wire.endTransmission() != 0)
+    return false;
+  if (_wire.requestFrom(_address, (uint8_t)2) != 2)
+    return false;
+  value = ((uint16_t)_wire.read() << 8);
+  value |= (uint16_t)_wire.read();
+  return true;
+}
@@ -0,0 +1,120 @@
+#ifndef __ADS1115_H__
+#define __ADS1115_H__
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#include "Thermistor.h"
+
+/***************************************************************************
+ * 
+ ***************************************************************************/
+
+// Programmable gain (full-scale range); values are the config register's
+// PGA field, so e.g. ADS1115_PGA_4_096V is Adafruit's GAIN_ONE
+typedef enum {
+  ADS1115_PGA_6_144V = 0, ADS1115_PGA_4_096V, ADS1115_PGA_2_048V,
+  ADS1115_PGA_1_024V, ADS1115_PGA_0_512V, ADS1115_PGA_0_256V,
+} ads1115_pga_t;
+
+// Data rate (samples per second); config register's DR field
+typedef enum {
+  ADS1115_RATE_8SPS = 0, ADS1115_RATE_16SPS, ADS1115_RATE_32SPS, ADS1115_RATE_64SPS,
+  ADS1115_RATE_128SPS, ADS1115_RATE_250SPS, ADS1115_RATE_475SPS, ADS1115_RATE_860SPS,
+} ads1115_rate_t;
+
+// ADS1115 driver that keeps the chip in continuous-conversion mode, and
+// rotates the input mux over a set of single-ended channels.  update()
+// never waits on a conversion: it collects a result only once one is
+// ready, as signalled by the ALERT/RDY pin (if connected), or else once
+// a conversion period has elapsed.  Each result goes into its channel's
+// buffer, from which it is read with pop() (e.g., by ADS1115ChannelPort).
+//
+// After each mux switch, the first result is discarded, since that
+// conversion may have started before the switch took effect.
+class ADS1115Continuous {
+public:
+  static const uint8_t DEFAULT_ADDRESS = 0x48;
+  static const uint8_t MAX_CHANNELS = 4;
+  static const uint8_t BUFFER_SIZE = 8;  // Per channel; power of 2
+
+  ADS1115Continuous(uint8_t address = DEFAULT_ADDRESS, TwoWire &wire = Wire)
+  : _address(address), _wire(wire), _rdyPin(-1), _nChannels(0), _current(0),
+    _discard(true), _rdy(false), _periodUs(0), _convStart(0), _conversions(0), _overruns(0) { }
+
+  // Add a single-ended input (AIN0..3); call before begin()
+  bool addChannel(uint8_t channel);
+
+  // Configure thresholds for conversion-ready signalling (if rdyPin >= 0)
+  // and start converting the first channel; returns false if no ACK
+  bool begin(ads1115_pga_t pga = ADS1115_PGA_4_096V, ads1115_rate_t rate = ADS1115_RATE_128SPS, int rdyPin = -1);
+
+  // Collect the finished conversion, if any, and move on to the next
+  // channel; returns true if a result was stored
+  bool update(uint32_t nowUs = micros());
+
+  // Oldest unread result for channel (AIN0..3), if any
+  bool pop(uint8_t channel, int16_t &value);
+  // Most recent result for channel, read or not
+  int16_t latest(uint8_t channel) const;
+
+  inline uint32_t conversions() const { return _conversions; }
+  inline uint32_t overruns() const { return _overruns; }  // Unread results overwritten
+
+private:
+  struct channel_t {
+    uint8_t ain;
+    int16_t buffer[BUFFER_SIZE];
+    uint8_t head, count;
+  };
+
+  uint8_t _address;
+  TwoWire &_wire;
+  int _rdyPin;
+  uint16_t _config;  // Without MUX
+  channel_t _channels[MAX_CHANNELS];
+  uint8_t _nChannels;
+  uint8_t _current;
+  bool _discard;
+  volatile bool _rdy;
+  uint32_t _periodUs;
+  uint32_t _convStart;
+  uint32_t _conversions, _overruns;
+
+  channel_t *_find(uint8_t ain);
+  const channel_t *_find(uint8_t ain) const;
+  bool _writeRegister(uint8_t reg, uint16_t value);
+  bool _readRegister(uint8_t reg, uint16_t &value);
+  void _startChannel(uint32_t nowUs);
+
+  static void IRAM_ATTR _onReady(void *arg);
+};
+
+// ADC port over one ADS1115Continuous channel; acquire() takes the oldest
+// unread result (or repeats the latest, if none), and never blocks.
+// Like BasicADS1115Port, values are relative to the PGA full-scale range.
+template <typename T>
+class ADS1115ChannelPort : public BasicADCPort<T> {
+public:
+  ADS1115ChannelPort(
+    ADS1115Continuous &ads, uint8_t channel,
+    T attenuation = T(1), uint8_t nSamples = ADCPortBase::DEFAULT_SAMPLES, uint32_t interval = ADCPortBase::DEFAULT_INTERVAL
+  )
+  : BasicADCPort<T>(attenuation, nSamples, interval), _ads(ads), _channel(channel) { }
+  virtual ~ADS1115ChannelPort() { }
+
+  virtual T acquire() override {
+    int16_t code;
+    if (_ads.pop(_channel, code))
+      this->_code(code);  // Repeats are not new inputs
+    else
+      code = _ads.latest(_channel);
+    return T((int)code) / 32767;
+  }
+
+private:
+  ADS1115Continuous &_ads;
+  uint8_t _channel;
+};
+
+#endif /* __ADS1115_H__ */
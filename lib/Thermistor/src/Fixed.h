@@ -0,0 +1,60 @@
+#ifndef __FIXED_H__
+#define __FIXED_H__
+
+#include <stdint.h>
+
+// Signed Q(31-FRAC).FRAC fixed-point number, in an int32_t.  Just enough
+// arithmetic for ADC averaging, smoothing and ThermistorTable
+// interpolation; products and quotients go through int64_t.  All
+// conversions are explicit, so that double/float arithmetic does not
+// sneak in unnoticed.
+template <uint8_t FRAC>
+class Fixed {
+public:
+  static const int32_t ONE = (int32_t)1 << FRAC;
+
+  constexpr Fixed() : _raw(0) { }
+  explicit constexpr Fixed(int value) : _raw((int32_t)value * ONE) { }
+  explicit constexpr Fixed(unsigned value) : _raw((int32_t)value * ONE) { }
+  explicit constexpr Fixed(long value) : _raw((int32_t)value * ONE) { }
+  explicit constexpr Fixed(unsigned long value) : _raw((int32_t)value * ONE) { }
+  explicit constexpr Fixed(float value) : _raw((int32_t)(value * ONE + (value >= 0 ? 0.5f : -0.5f))) { }
+  explicit constexpr Fixed(double value) : _raw((int32_t)(value * ONE + (value >= 0 ? 0.5 : -0.5))) { }
+
+  static constexpr Fixed fromRaw(int32_t raw) { return Fixed(raw, true); }
+  inline int32_t raw() const { return _raw; }
+
+  explicit operator float() const { return (float)_raw / ONE; }
+  explicit operator double() const { return (double)_raw / ONE; }
+  explicit operator int() const { return _raw >> FRAC; }  // Rounds towards -inf
+
+  inline Fixed operator-() const { return fromRaw(-_raw); }
+  inline Fixed operator+(Fixed rhs) const { return fromRaw(_raw + rhs._raw); }
+  inline Fixed operator-(Fixed rhs) const { return fromRaw(_raw - rhs._raw); }
+  inline Fixed operator*(Fixed rhs) const { return fromRaw((int32_t)(((int64_t)_raw * rhs._raw) >> FRAC)); }
+  inline Fixed operator/(Fixed rhs) const { return fromRaw((int32_t)(((int64_t)_raw << FRAC) / rhs._raw)); }
+  inline Fixed operator*(int rhs) const { return fromRaw(_raw * rhs); }
+  inline Fixed operator/(int rhs) const { return fromRaw(_raw / rhs); }
+
+  inline Fixed &operator+=(Fixed rhs) { _raw += rhs._raw;  return *this; }
+  inline Fixed &operator-=(Fixed rhs) { _raw -= rhs._raw;  return *this; }
+
+  inline bool operator==(Fixed rhs) const { return _raw == rhs._raw; }
+  inline bool operator!=(Fixed rhs) const { return _raw != rhs._raw; }
+  inline bool operator<(Fixed rhs) const { return _raw < rhs._raw; }
+  inline bool operator<=(Fixed rhs) const { return _raw <= rhs._raw; }
+  inline bool operator>(Fixed rhs) const { return _raw > rhs._raw; }
+  inline bool operator>=(Fixed rhs) const { return _raw >= rhs._raw; }
+
+private:
+  constexpr Fixed(int32_t raw, bool) : _raw(raw) { }
+
+  int32_t _raw;
+};
+
+template <uint8_t FRAC> const int32_t Fixed<FRAC>::ONE;
+
+// Enough range for temperatures in any unit, and ~1.5e-5 resolution
+typedef Fixed<16> q16_16_t;
+
+#endif /* __FIXED_H__ */
@@ -0,0 +1,114 @@
+#include "I2SADC.h"
+
+#ifdef ARDUINO_ARCH_ESP32
+
+#include <soc/syscon_struct.h>
+
+static const i2s_port_t I2S_PORT = I2S_NUM_0;
+
+bool I2SADCSampler::addPin(uint8_t pin) {
+  int8_t channel = digitalPinToAnalogChannel(pin);
+  if (_running || _nPins >= MAX_PINS || channel < 0 || channel >= ADC1_CHANNEL_MAX)
+    return false;
+  decimator_t &d = _pins[_nPins++];
+  d.pin = pin;
+  d.channel = channel;
+  d.sum = d.lastSum = 0;
+  d.count = 0;
+  d.valid = d.fresh = false;
+  return true;
+}
+
+bool I2SADCSampler::begin(adc_atten_t attenuation) {
+  if (_nPins == 0)
+    return false;
+
+  i2s_config_t config;
+  memset(&config, 0, sizeof(config));
+  config.mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN);
+  config.sample_rate = _sampleRate;
+  config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+  config.channel_format = I2S_CHANNEL_FMT_ONLY_LEFT;
+  config.communication_format = I2S_COMM_FORMAT_I2S_MSB;
+  config.dma_buf_count = DMA_BUF_COUNT;
+  config.dma_buf_len = DMA_BUF_LEN;
+  config.use_apll = false;
+  if (i2s_driver_install(I2S_PORT, &config, 0, NULL) != ESP_OK)
+    return false;
+
+  adc1_config_width(ADC_WIDTH_BIT_12);
+  for (uint8_t i = 0;  i < _nPins;  i++)
+    adc1_config_channel_atten((adc1_channel_t)_pins[i].channel, attenuation);
+  if (i2s_set_adc_mode(ADC_UNIT_1, (adc1_channel_t)_pins[0].channel) != ESP_OK)
+    return false;
+
+  // i2s_set_adc_mode() only sets up a single channel; scan all pins, via
+  // the SAR1 pattern table (one byte per entry: channel, width, atten)
+  uint32_t pattern = 0;
+  for (uint8_t i = 0;  i < _nPins;  i++) {
+    uint8_t entry = (_pins[i].channel << 4) | (ADC_WIDTH_BIT_12 << 2) | attenuation;
+    pattern |= (uint32_t)entry << (24 - 8*i);
+  }
+  SYSCON.saradc_ctrl.sar1_patt_len = _nPins - 1;
+  SYSCON.saradc_sar1_patt_tab[0] = pattern;
+
+  if (i2s_adc_enable(I2S_PORT) != ESP_OK)
+    return false;
+  _running = true;
+  return true;
+}
+
+uint8_t I2SADCSampler::update() {
+  if (!_running)
+    return 0;
+  uint8_t readings = 0;
+  size_t bytesRead;
+  // Zero timeout: only what the DMA has already completed
+  while (i2s_read(I2S_PORT, _dmaBuf, sizeof(_dmaBuf), &bytesRead, 0) == ESP_OK && bytesRead > 0) {
+    size_t n = bytesRead / sizeof(_dmaBuf[0]);
+    for (size_t i = 0;  i < n;  i++) {
+      // Each sample is tagged with its channel, in the top 4 bits
+      uint8_t channel = _dmaBuf[i] >> 12;
+      for (uint8_t j = 0;  j < _nPins;  j++) {
+        decimator_t &d = _pins[j];
+        if (d.channel != channel)
+          continue;
+        d.sum += _dmaBuf[i] & 0x0fff;
+        if (++d.count >= _decimation) {
+          d.lastSum = d.sum;
+          d.sum = 0;
+          d.count = 0;
+          d.valid = d.fresh = true;
+          readings++;
+        }
+        break;
+      }
+    }
+  }
+  return readings;
+}
+
+bool I2SADCSampler::read(uint8_t pin, float &value, bool *fresh) {
+  for (uint8_t j = 0;  j < _nPins;  j++) {
+    decimator_t &d = _pins[j];
+    if (d.pin != pin)
+      continue;
+    if (!d.valid)
+      return false;
+    value = (float)d.lastSum / ((float)_decimation * 4095.0f);
+    if (fresh)
+      *fresh = d.fresh;
+    d.fresh = false;
+    return true;
+  }
+  return false;
+}
+
+bool I2SADCSampler::valid(uint8_t pin) const {
+  for (uint8_t j = 0;  j < _nPins;  j++)
+    if (_pins[j].pin == pin)
+      return _pins[j].valid;
+  return false;
+}
+
+#endif  // ARDUINO_ARCH_ESP32
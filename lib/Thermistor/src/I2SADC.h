@@ -0,0 +1,108 @@
+#ifndef __I2SADC_H__
+#define __I2SADC_H__
+
+#include <Arduino.h>
+
+#include "Thermistor.h"
+
+#ifdef ARDUINO_ARCH_ESP32  // I2S-ADC is specific to the (original) ESP32
+
+#include <driver/i2s.h>
+#include <driver/adc.h>
+
+/***************************************************************************
+ * 
+ ***************************************************************************/
+
+// Continuous sampling of up to 4 ADC1 pins (GPIO 32..39), via the I2S
+// peripheral's built-in ADC mode: the SAR controller scans the pins and
+// DMA fills a ring of buffers, without any CPU involvement.  update()
+// then drains whatever the DMA has filled (without waiting), and feeds
+// each pin's samples into a boxcar decimator (a first-order CIC), which
+// produces one reading per `decimation` samples.
+//
+// The boxcar has nulls at multiples of 1/window, so a window of 100 msec
+// (the default: 20 kHz total, i.e., 10 kHz per pin for two pins, and
+// decimation by 1000) rejects both 50 and 60 Hz mains hum, on top of
+// averaging out ~sqrt(1000) of the white noise.  Note that the actual
+// I2S-ADC rate is only approximately the configured one.
+//
+// Uses I2S_NUM_0, and takes over ADC1 (analogRead() on ADC1 pins will
+// not work while running).  update() must be called more often than the
+// DMA ring wraps around (DMA_BUF_COUNT * DMA_BUF_LEN samples; ~50 msec
+// at 20 kHz), or samples are lost (which just shortens the window).
+class I2SADCSampler {
+public:
+  static const uint8_t MAX_PINS = 4;
+  static const uint32_t DEFAULT_SAMPLE_RATE = 20000;
+  static const uint16_t DEFAULT_DECIMATION = 1000;
+  static const int DMA_BUF_COUNT = 4;
+  static const int DMA_BUF_LEN = 256;  // Samples
+
+  I2SADCSampler(uint32_t sampleRate = DEFAULT_SAMPLE_RATE, uint16_t decimation = DEFAULT_DECIMATION)
+  : _sampleRate(sampleRate), _decimation(decimation), _nPins(0), _running(false) { }
+
+  // Add pin to scan; call before begin()
+  bool addPin(uint8_t pin);
+
+  bool begin(adc_atten_t attenuation = ADC_ATTEN_DB_6);
+
+  // Drain DMA buffers and decimate; returns number of new readings
+  uint8_t update();
+
+  // Most recent reading for pin, as a fraction of full scale (0.0..1.0);
+  // returns false if none yet.  fresh is set if not returned before.
+  bool read(uint8_t pin, float &value, bool *fresh = NULL);
+  // True once pin has a complete window
+  bool valid(uint8_t pin) const;
+
+private:
+  struct decimator_t {
+    uint8_t pin;
+    uint8_t channel;  // ADC1 channel
+    uint32_t sum;
+    uint16_t count;
+    uint32_t lastSum;  // Of most recent complete window
+    bool valid, fresh;
+  };
+
+  uint32_t _sampleRate;
+  uint16_t _decimation;
+  decimator_t _pins[MAX_PINS];
+  uint8_t _nPins;
+  bool _running;
+  uint16_t _dmaBuf[DMA_BUF_LEN];
+};
+
+// ADC port over one I2SADCSampler pin.  Readings are already decimated,
+// so by default each measurement is a single, undelayed acquire().  Until
+// the first window completes, sampling is held off, so measurements never
+// see a made-up value.
+template <typename T>
+class I2SADCPort : public BasicADCPort<T> {
+public:
+  I2SADCPort(
+    I2SADCSampler &sampler, uint8_t pin,
+    T attenuation = T(1), uint8_t nSamples = 1, uint32_t interval = 0
+  )
+  : BasicADCPort<T>(attenuation, nSamples, interval), _sampler(sampler), _pin(pin) { }
+  virtual ~I2SADCPort() { }
+
+  virtual T acquire() override {
+    float value = 0;
+    _sampler.read(_pin, value);
+    this->_code(lroundf(value * 4095));  // Decimated, so not exactly a code
+    return T(value);
+  }
+
+protected:
+  virtual bool _available() const override { return _sampler.valid(_pin); }
+
+private:
+  I2SADCSampler &_sampler;
+  uint8_t _pin;
+};
+
+#endif  // ARDUINO_ARCH_ESP32
+
+#endif /* __I2SADC_H__ */
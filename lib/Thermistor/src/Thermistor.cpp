@@ -2,6 +2,8 @@
 
 #include "Thermistor.h"
 
+#include <cmath>
+
 /*
 
 R = Rref / (res/adc - 1)
@@ -20,12 +22,20 @@ ln(R/R0) = ln(Rref/R0) - ln(res/adc - 1)
 
 */
 
-double Thermistor::kelvin() {
-  double C = _logConst - log(1.0/_adcPort.measure() - 1.0)/_beta;
-  double tempK = 1.0/(_invNomT + C);
-  if (_lastKelvin >= 0.0) {
-    tempK = _lambda*tempK + (1.0-_lambda)*_lastKelvin;
+template <typename T>
+bool BasicThermistor<T>::available() {
+  if (!_adcPort.ready())
+    return false;
+
+  using std::log;  // Overload for T (i.e., logf for float)
+  T C = _logConst - log(T(1)/_adcPort.read() - T(1))/_beta;
+  T tempK = T(1)/(_invNomT + C);
+  if (_lastKelvin >= T(0)) {
+    tempK = _lambda*tempK + (T(1)-_lambda)*_lastKelvin;
   }
   _lastKelvin = tempK;
-  return tempK;
-}
\ No newline at end of file
+  return true;
+}
+
+template class BasicThermistor<double>;
+template class BasicThermistor<float>;
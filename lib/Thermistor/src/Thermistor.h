@@ -7,86 +7,267 @@
 #include <Adafruit_ADS1015.h>
 #endif
 
+#include "Fixed.h"
+#include "ADCFilter.h"
+
 /***************************************************************************
  * 
  ***************************************************************************/
 
-// Abstract base class
-class ADCPort {
+// Abstract base class, with the sampling schedule (independent of
+// numeric type; see BasicADCPort)
+//
+// Measurements are acquired incrementally, so that averaging does not
+// block the caller: request() starts a new measurement, and each call to
+// sample() takes exactly one ADC reading.  Once nSamples readings have
+// been taken (or fewer, as decided by a filter; see ADCFilter.h), ready()
+// becomes true and the average can be obtained via read().  Normally
+// sample() is not called directly, but via ADCSampler.
+class ADCPortBase {
 public:
   static const uint8_t DEFAULT_SAMPLES = 5;
   static const uint32_t DEFAULT_INTERVAL = 30;
 
-  ADCPort(double attenuation = 1.0, uint8_t nSamples = DEFAULT_SAMPLES, uint32_t interval = DEFAULT_INTERVAL)
-  : _attenuation(attenuation), _nSamples(nSamples), _interval(interval) { }
-  virtual ~ADCPort() { }
-  virtual double acquire() = 0;  // Should return adc_value/resolution (i.e., in 0.0..1.0 range)
+  ADCPortBase(uint8_t nSamples, uint32_t interval)
+  : _nSamples(nSamples), _interval(interval),
+    _count(0), _lastSample(0), _busy(false), _ready(false), _totalSamples(0),
+    _codeHook(NULL), _codeTag(0) { }
+  virtual ~ADCPortBase() { }
+
+  // Start a new measurement; no-op if one is already in progress
+  void request() {
+    if (_busy)
+      return;
+    _reset();
+    _count = 0;
+    _busy = true;
+    _ready = false;
+  }
+
+  inline bool busy() const { return _busy; }
+  inline bool ready() const { return _ready; }
+  inline uint32_t totalSamples() const { return _totalSamples; }  // i.e., conversions
+
+  // Called with every raw ADC code acquired (e.g., to record a trace),
+  // along with tag; NULL to disable
+  typedef void (*code_hook_t)(uint8_t tag, int32_t code);
+  inline void setCodeHook(code_hook_t hook, uint8_t tag = 0) {
+    _codeHook = hook;
+    _codeTag = tag;
+  }
+
+  // True if measurement in progress, inter-sample interval has elapsed,
+  // and the source has something to acquire
+  inline bool due(uint32_t now) const {
+    return _busy && (_count == 0 || now - _lastSample >= _interval) && _available();
+  }
 
-  double measure() {
-    double sum = 0.0;
-    for (uint8_t i = 0;  i < _nSamples;  i++) {
-      sum += acquire();
-      delay(_interval);
+  void sample(uint32_t now) {
+    _accumulate();
+    _lastSample = now;
+    _totalSamples++;
+    ++_count;
+    if (_complete()) {
+      _finish();
+      _busy = false;
+      _ready = true;
     }
-    double val = sum / _nSamples * _attenuation;
-    Serial.printf("****  Measurement %f\n", val);
-    return val;
   }
 
-private:
-  double _attenuation;
+protected:
+  virtual void _reset() = 0;
+  virtual void _accumulate() = 0;  // Take one sample
+  virtual void _finish() = 0;  // Compute measurement from _count samples
+  virtual bool _complete() const { return _count >= _nSamples; }
+  virtual bool _available() const { return true; }  // False holds off sampling (e.g., no data yet)
+
+  // For acquire() implementations
+  inline void _code(int32_t code) {
+    if (_codeHook)
+      _codeHook(_codeTag, code);
+  }
+
   uint8_t _nSamples;
   uint32_t _interval;
+
+  // Measurement in progress
+  uint8_t _count;
+  uint32_t _lastSample;
+  bool _busy;
+  bool _ready;
+  uint32_t _totalSamples;
+  code_hook_t _codeHook;
+  uint8_t _codeTag;
 };
 
-class MCUPort : public ADCPort {
+// T is the numeric type of samples and measurements: double, float, or
+// Fixed (see the comparison in BasicThermistor below)
+template <typename T>
+class BasicADCPort : public ADCPortBase {
 public:
-  MCUPort(int pin, double attenuation = 1.0, uint8_t nSamples = DEFAULT_SAMPLES, uint32_t interval = DEFAULT_INTERVAL)
-  : ADCPort(attenuation, nSamples, interval), _pin(pin) { }
-  virtual ~MCUPort() { }
-
-  virtual double acquire() override { 
-    double val = ((double)analogRead(_pin)) / 4095.0;
-    Serial.printf("****  ADC reading %f\n", val);
-    return val;
+  BasicADCPort(T attenuation = T(1), uint8_t nSamples = DEFAULT_SAMPLES, uint32_t interval = DEFAULT_INTERVAL)
+  : ADCPortBase(nSamples, interval), _attenuation(attenuation), _sum(0), _value(0), _filter(NULL) { }
+  virtual ~BasicADCPort() { }
+  virtual T acquire() = 0;  // Should return adc_value/resolution (i.e., in 0.0..1.0 range)
+
+  // Use filter instead of plain average (NULL to revert); nSamples then
+  // becomes the maximum.  Set before the first request().
+  inline void setFilter(ADCFilter<T> *filter) { _filter = filter; }
+
+  // Returns last complete measurement, and clears ready() flag
+  T read() {
+    _ready = false;
+    return _value;
+  }
+
+protected:
+  virtual void _reset() override {
+    if (_filter)
+      _filter->reset();
+    else
+      _sum = T(0);
+  }
+  virtual void _accumulate() override {
+    if (_filter)
+      _filter->add(acquire());
+    else
+      _sum += acquire();
+  }
+  virtual bool _complete() const override {
+    return _filter ? _filter->complete(_count, _nSamples) : (_count >= _nSamples);
+  }
+  virtual void _finish() override {
+    _value = (_filter ? _filter->result() : _sum / (int)_count) * _attenuation;
+  }
+
+private:
+  T _attenuation;
+  T _sum;
+  T _value;
+  ADCFilter<T> *_filter;
+};
+
+typedef BasicADCPort<double> ADCPort;
+
+template <typename T>
+class BasicMCUPort : public BasicADCPort<T> {
+public:
+  BasicMCUPort(int pin, T attenuation = T(1), uint8_t nSamples = ADCPortBase::DEFAULT_SAMPLES, uint32_t interval = ADCPortBase::DEFAULT_INTERVAL)
+  : BasicADCPort<T>(attenuation, nSamples, interval), _pin(pin) { }
+  virtual ~BasicMCUPort() { }
+
+  virtual T acquire() override { 
+    uint16_t code = analogRead(_pin);
+    this->_code(code);
+    return T(code) / 4095;
   }
 
 private:
   int _pin;
 };
 
+typedef BasicMCUPort<double> MCUPort;
+
 #ifdef THERMISTOR_CONFIG_ADS1115
-class ADS1115Port : public ADCPort {
+template <typename T>
+class BasicADS1115Port : public BasicADCPort<T> {
 public:
-  ADS1115Port(
+  BasicADS1115Port(
     Adafruit_ADS1015& ads, uint8_t channel,
-    double attenuation = 1.0, uint8_t nSamples = DEFAULT_SAMPLES, uint32_t interval = DEFAULT_INTERVAL
+    T attenuation = T(1), uint8_t nSamples = ADCPortBase::DEFAULT_SAMPLES, uint32_t interval = ADCPortBase::DEFAULT_INTERVAL
   ) 
-  : ADCPort(attenuation, nSamples, interval), _ads(ads), _channel(channel) { }
-  virtual ~ADS1115Port() { }
+  : BasicADCPort<T>(attenuation, nSamples, interval), _ads(ads), _channel(channel) { }
+  virtual ~BasicADS1115Port() { }
 
-  virtual double acquire() override { 
-    double val = ((double)_ads.readADC_SingleEnded(_channel)) / 32767.0;
-    Serial.printf("****  ADC reading %f\n", val);
-    return val;
+  virtual T acquire() override { 
+    int16_t code = _ads.readADC_SingleEnded(_channel);
+    this->_code(code);
+    return T((int)code) / 32767;
   }
 
 private:
   Adafruit_ADS1015& _ads;
   uint8_t _channel;
 };
+
+typedef BasicADS1115Port<double> ADS1115Port;
 #endif
 
 /***************************************************************************
  * 
  ***************************************************************************/
 
+// Interleaves sampling of multiple ports.  Each call to update() takes at
+// most one sample, from the next port (in round-robin order) that is due,
+// so a single call never blocks for more than one ADC conversion.
+class ADCSampler {
+public:
+  static const uint8_t MAX_PORTS = 4;
+
+  ADCSampler() : _nPorts(0), _next(0) { }
+
+  bool add(ADCPortBase& port) {
+    if (_nPorts >= MAX_PORTS)
+      return false;
+    _ports[_nPorts++] = &port;
+    return true;
+  }
 
+  // True if any port has a measurement in progress
+  bool busy() const {
+    for (uint8_t i = 0;  i < _nPorts;  i++)
+      if (_ports[i]->busy())
+        return true;
+    return false;
+  }
 
-class Thermistor {
+  // Returns true if a sample was taken
+  bool update(uint32_t now = millis()) {
+    for (uint8_t i = 0;  i < _nPorts;  i++) {
+      uint8_t j = (_next + i) % _nPorts;
+      if (_ports[j]->due(now)) {
+        _ports[j]->sample(now);
+        _next = (j + 1) % _nPorts;
+        return true;
+      }
+    }
+    return false;
+  }
+
+private:
+  ADCPortBase* _ports[MAX_PORTS];
+  uint8_t _nPorts;
+  uint8_t _next;
+};
+
+/***************************************************************************
+ * 
+ ***************************************************************************/
+
+// T is the numeric type for the beta equation; only float and double are
+// supported (explicitly instantiated in Thermistor.cpp), since 1/T0 and
+// ln(R/R0)/B are far below Q16.16 resolution.  For fixed-point, use
+// TableThermistor (see ThermistorTable.h) instead.
+//
+// Numeric type comparison, readings over 50..110'F vs the double formula,
+// and conversion cost (convert_* in bench/bench_thermistor.cpp, median of
+// 15 runs; host timings on x86-64, which has a double FPU, so they
+// understate the gap on the ESP32, where double is software-emulated):
+//
+//   Sensor                        max error    conversion
+//   BasicThermistor<double>        (exact)      16.9 ns
+//   BasicThermistor<float>         0.0001'F     13.1 ns
+//   TableThermistor<.., double>    0.0038'F      3.5 ns
+//   TableThermistor<.., float>     0.0038'F      3.5 ns
+//   TableThermistor<.., q16_16_t>  0.0038'F      3.2 ns
+//
+// All are well within +/-0.1'F.  The table with float is the default in
+// main.cpp; q16_16_t avoids the FPU altogether (e.g., for use in an ISR).
+template <typename T>
+class BasicThermistor {
 public:
-  Thermistor(
-    ADCPort& adcPort, double referenceResistance, 
+  BasicThermistor(
+    BasicADCPort<T>& adcPort, double referenceResistance, 
     double nominalResistance, double nominalTemperatureCelsius,
     double beta,
     double lambda = 1.0  // No smoothing
@@ -99,25 +280,33 @@ public:
     _logConst(log(referenceResistance/nominalResistance)/beta)
   { }
   
-  inline double celsius() { return kelvin() - 273.15; }
-  inline double fahrenheit() { return 32.0 + 1.8 * celsius(); };
-  double kelvin();
+  // Start a new (non-blocking) measurement; see ADCPortBase::request()
+  inline void request() { _adcPort.request(); }
+  // Returns true (once) when a new reading is available, after converting it
+  bool available();
+
+  // Most recent reading (smoothed)
+  inline T celsius() const { return kelvin() - T(273.15); }
+  inline T fahrenheit() const { return T(32) + T(1.8) * celsius(); };
+  inline T kelvin() const { return _lastKelvin; }
 
 private:
-  ADCPort& _adcPort;
+  BasicADCPort<T>& _adcPort;
 
-  double _refR;  // Reference resistance (Ohm)
-  double _nomR;  // Nominal thermistor resistance (Ohm)
-  double _nomT;  // Nominal thermistor temperature (Kelvin)
-  double _beta;  // Beta coefficient (unitless)
+  T _refR;  // Reference resistance (Ohm)
+  T _nomR;  // Nominal thermistor resistance (Ohm)
+  T _nomT;  // Nominal thermistor temperature (Kelvin)
+  T _beta;  // Beta coefficient (unitless)
 
   // Used for exponential smoothing
-  double _lambda;
-  double _lastKelvin;
+  T _lambda;
+  T _lastKelvin;
 
   // Derived values, to slighly speed up calculations
-  double _invNomT;  // 1/T0
-  double _logConst; // ln(Rref/R0)/B
+  T _invNomT;  // 1/T0
+  T _logConst; // ln(Rref/R0)/B
 };
 
-#endif /* __THERMISTOR_H__ */
\ No newline at end of file
+typedef BasicThermistor<double> Thermistor;
+
+#endif /* __THERMISTOR_H__ */
@@ -0,0 +1,135 @@
+#ifndef __THERMISTOR_TABLE_H__
+#define __THERMISTOR_TABLE_H__
+
+#include "Thermistor.h"
+
+typedef enum { UNIT_KELVIN, UNIT_CELSIUS, UNIT_FAHRENHEIT } temperature_unit_t;
+
+/***************************************************************************
+ * 
+ ***************************************************************************/
+
+// Piecewise-linear approximation of the beta equation, mapping the ADC
+// ratio (adc_value/resolution, after attenuation, as returned by
+// BasicADCPort::read()) straight to temperature in UNIT, with no log() or
+// double arithmetic per reading; T is the numeric type of the entries and
+// the interpolation (float, double, or Fixed).  The table has 2^BITS equal segments
+// over 0..1 and is built once, at construction, from the same parameters
+// as Thermistor (these are runtime doubles, so cannot be template args).
+//
+// Max interpolation error vs the exact formula, for the 10K/3950 sensor
+// and 10K reference in main.cpp:
+//   BITS    50..110'F    32..212'F    size
+//      6     0.015'F      0.47'F      260 bytes
+//      7     0.004'F      0.13'F      516 bytes
+//      8     0.001'F      0.03'F     1028 bytes
+template <temperature_unit_t UNIT, uint8_t BITS = 7, typename T = float>
+class ThermistorTable {
+public:
+  static const uint16_t SEGMENTS = 1 << BITS;
+
+  ThermistorTable(
+    double referenceResistance, double nominalResistance,
+    double nominalTemperatureCelsius, double beta
+  ) {
+    double invNomT = 1.0/(nominalTemperatureCelsius + 273.15);
+    double logConst = log(referenceResistance/nominalResistance)/beta;
+    for (uint16_t i = 0;  i <= SEGMENTS;  i++) {
+      // Endpoints are infinitely hot/cold, so evaluate half a segment in
+      double x = (double)i / SEGMENTS;
+      if (i == 0)
+        x = 0.5 / SEGMENTS;
+      else if (i == SEGMENTS)
+        x = 1.0 - 0.5 / SEGMENTS;
+      double tempK = 1.0/(invNomT + logConst - log(1.0/x - 1.0)/beta);
+      _table[i] = T(fromKelvin(tempK));
+    }
+  }
+
+  T operator()(T x) const {
+    T f = x * (int)SEGMENTS;
+    if (f <= T(0))
+      return _table[0];
+    if (f >= T((int)SEGMENTS))
+      return _table[SEGMENTS];
+    int i = (int)f;
+    return _table[i] + (f - T(i)) * (_table[i+1] - _table[i]);
+  }
+
+  // Unit conversions; UNIT is a compile-time constant, so these fold away
+  template <typename V>
+  static inline V fromKelvin(V tempK) {
+    switch (UNIT) {
+      case UNIT_CELSIUS: return tempK - V(273.15);
+      case UNIT_FAHRENHEIT: return V(32) + V(1.8) * (tempK - V(273.15));
+      default: return tempK;
+    }
+  }
+  template <typename V>
+  static inline V toKelvin(V temp) {
+    switch (UNIT) {
+      case UNIT_CELSIUS: return temp + V(273.15);
+      case UNIT_FAHRENHEIT: return (temp - V(32)) / V(1.8) + V(273.15);
+      default: return temp;
+    }
+  }
+
+private:
+  T _table[SEGMENTS + 1];
+};
+
+/***************************************************************************
+ * 
+ ***************************************************************************/
+
+// Drop-in alternative to Thermistor, converting via ThermistorTable.
+// Smoothing is applied in UNIT, which is equivalent since all units are
+// affine in Kelvin.
+template <temperature_unit_t UNIT, uint8_t BITS = 7, typename T = float>
+class TableThermistor {
+public:
+  TableThermistor(
+    BasicADCPort<T>& adcPort, double referenceResistance, 
+    double nominalResistance, double nominalTemperatureCelsius,
+    double beta,
+    double lambda = 1.0  // No smoothing
+  )
+  : _adcPort(adcPort),
+    _table(referenceResistance, nominalResistance, nominalTemperatureCelsius, beta),
+    _lambda(lambda),
+    _last(0), _valid(false)
+  { }
+
+  // Same semantics as Thermistor::request() and Thermistor::available()
+  inline void request() { _adcPort.request(); }
+  bool available() {
+    if (!_adcPort.ready())
+      return false;
+    T temp = _table(_adcPort.read());
+    if (_valid) {
+      temp = _lambda*temp + (T(1)-_lambda)*_last;
+    }
+    _last = temp;
+    _valid = true;
+    return true;
+  }
+
+  // Most recent reading (smoothed); value() is in UNIT
+  inline T value() const { return _last; }
+  inline T kelvin() const { return Table::toKelvin(_last); }
+  inline T celsius() const { return (UNIT == UNIT_CELSIUS) ? _last : kelvin() - T(273.15); }
+  inline T fahrenheit() const { return (UNIT == UNIT_FAHRENHEIT) ? _last : T(32) + T(1.8) * celsius(); }
+
+private:
+  typedef ThermistorTable<UNIT, BITS, T> Table;
+
+  BasicADCPort<T>& _adcPort;
+  Table _table;
+
+  // Used for exponential smoothing
+  T _lambda;
+  T _last;
+  bool _valid;
+};
+
+#endif /* __THERMISTOR_TABLE_H__ */
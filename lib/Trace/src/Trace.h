@@ -0,0 +1,234 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+
+// Trace of raw inputs (ADC codes, digital pins, incoming MQTT messages),
+// for replaying on the host (see NativeHAL.h).  Fields are little-endian,
+// packed byte by byte.  A file starts with "PTRC" and a version byte,
+// followed by events:
+//
+//   Event (8 bytes): uint32 ms (millis() when read), uint8 type,
+//                    uint8 id (pin or channel), uint16 value (code or level)
+//
+// For TRACE_COMMAND, id and value are the topic and payload lengths, and
+// the event is followed by topic and payload bytes (no terminators).
+// Bump the version on any layout change.
+static const uint8_t TRACE_MAGIC[4] = { 'P', 'T', 'R', 'C' };
+static const uint8_t TRACE_VERSION = 1;
+static const uint8_t TRACE_HEADER_SIZE = 5;
+static const uint8_t TRACE_EVENT_SIZE = 8;
+
+typedef enum : uint8_t {
+  TRACE_ADC = 1,  // ESP32 ADC code (12 bits), by pin
+  TRACE_ADS1115 = 2,  // ADS1115 code (int16_t), by channel
+  TRACE_PIN = 3,  // Digital input level, by pin
+  TRACE_COMMAND = 4,  // Incoming MQTT message
+} trace_type_t;
+
+typedef struct {
+  uint32_t ms;
+  trace_type_t type;
+  uint8_t id;
+  uint16_t value;
+} trace_event_t;
+
+// Appends events to a file, via stdio; on the ESP32 that is a VFS path,
+// e.g. "/spiffs/trace.bin" once SPIFFS.begin() has mounted it.  With
+// maxBytes, the file is a ring in two halves: once it grows past half,
+// it becomes "<path>.old" (replacing any previous one) and a new file is
+// started, so the most recent maxBytes/2 to maxBytes are always there.
+// Without, it just grows.
+//
+// Events are written as recorded, which need not be in time order when
+// they come from more than one task; TraceReader users should sort.
+// Writes go through the stdio buffer, so call flush() every so often.
+// Not thread-safe.
+class TraceWriter {
+public:
+  static const uint8_t MAX_TOPIC = 64;
+  static const uint8_t MAX_PAYLOAD = 64;
+  static const size_t MAX_PATH = 32;
+
+  TraceWriter() : _f(NULL), _path(NULL), _maxBytes(0), _size(0), _events(0), _rotations(0) { }
+  ~TraceWriter() { end(); }
+
+  // Starts a new trace at path (which must have static storage)
+  bool begin(const char *path, size_t maxBytes = 0) {
+    end();
+    if (strlen(path) + 4 >= MAX_PATH)
+      return false;
+    _path = path;
+    _maxBytes = maxBytes;
+    return _open();
+  }
+
+  void end() {
+    if (_f) {
+      fclose(_f);
+      _f = NULL;
+    }
+  }
+
+  bool write(const trace_event_t &e) {
+    return _write(e, NULL, 0, NULL, 0);
+  }
+
+  bool command(uint32_t ms, const char *topic, const uint8_t *payload, unsigned int length) {
+    size_t topicLength = strlen(topic);
+    if (topicLength > MAX_TOPIC || length > MAX_PAYLOAD)
+      return false;
+    trace_event_t e = { ms, TRACE_COMMAND, (uint8_t)topicLength, (uint16_t)length };
+    return _write(e, (const uint8_t *)topic, topicLength, payload, length);
+  }
+
+  void flush() {
+    if (_f)
+      fflush(_f);
+  }
+
+  inline bool active() const { return _f != NULL; }
+  inline uint32_t events() const { return _events; }
+  inline uint32_t rotations() const { return _rotations; }
+
+private:
+  FILE *_f;
+  const char *_path;
+  size_t _maxBytes;
+  size_t _size;  // Of current file
+  uint32_t _events;
+  uint32_t _rotations;
+
+  bool _open() {
+    _f = fopen(_path, "wb");
+    if (!_f)
+      return false;
+    uint8_t header[TRACE_HEADER_SIZE];
+    memcpy(header, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header[4] = TRACE_VERSION;
+    _size = 0;
+    return _put(header, sizeof(header));
+  }
+
+  void _rotate() {
+    char oldPath[MAX_PATH];
+    snprintf(oldPath, sizeof(oldPath), "%s.old", _path);
+    end();
+    remove(oldPath);
+    rename(_path, oldPath);
+    _rotations++;
+    _open();
+  }
+
+  bool _write(const trace_event_t &e, const uint8_t *a, size_t aLength, const uint8_t *b, size_t bLength) {
+    if (!_f)
+      return false;
+    if (_maxBytes && _size + TRACE_EVENT_SIZE + aLength + bLength > _maxBytes / 2) {
+      _rotate();
+      if (!_f)
+        return false;
+    }
+    uint8_t buf[TRACE_EVENT_SIZE];
+    uint8_t *p = buf;
+    p = _put32(p, e.ms);
+    *p++ = e.type;
+    *p++ = e.id;
+    _put16(p, e.value);
+    if (!_put(buf, sizeof(buf)) || !_put(a, aLength) || !_put(b, bLength))
+      return false;
+    _events++;
+    return true;
+  }
+
+  // Gives up on the trace on any error (e.g., flash full)
+  bool _put(const uint8_t *data, size_t length) {
+    if (length > 0 && fwrite(data, 1, length, _f) != length) {
+      end();
+      return false;
+    }
+    _size += length;
+    return true;
+  }
+
+  static inline uint8_t* _put16(uint8_t* p, uint16_t v) {
+    *p++ = v & 0xff;
+    *p++ = v >> 8;
+    return p;
+  }
+
+  static inline uint8_t* _put32(uint8_t* p, uint32_t v) {
+    p = _put16(p, v & 0xffff);
+    return _put16(p, v >> 16);
+  }
+};
+
+// Reads back one trace file, e.g. on the host; for a ring, read
+// "<path>.old" first, then path.
+class TraceReader {
+public:
+  TraceReader() : _f(NULL) { }
+  ~TraceReader() { close(); }
+
+  // Fails if the file is missing, or not a trace of this version
+  bool open(const char *path) {
+    close();
+    _f = fopen(path, "rb");
+    if (!_f)
+      return false;
+    uint8_t header[TRACE_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), _f) != sizeof(header)
+        || memcmp(header, TRACE_MAGIC, sizeof(TRACE_MAGIC)) || header[4] != TRACE_VERSION) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  void close() {
+    if (_f) {
+      fclose(_f);
+      _f = NULL;
+    }
+  }
+
+  // Next event; for TRACE_COMMAND, topic and payload are filled in (and
+  // NUL-terminated), so must have room for MAX_TOPIC+1 and MAX_PAYLOAD+1
+  // bytes.  Returns false at the end (a truncated last event is ignored).
+  bool next(trace_event_t &e, char *topic, char *payload) {
+    uint8_t buf[TRACE_EVENT_SIZE];
+    if (!_f || fread(buf, 1, sizeof(buf), _f) != sizeof(buf))
+      return false;
+    e.ms = _get32(buf);
+    e.type = (trace_type_t)buf[4];
+    e.id = buf[5];
+    e.value = _get16(buf + 6);
+    if (e.type != TRACE_COMMAND)
+      return true;
+    if (e.id > TraceWriter::MAX_TOPIC || e.value > TraceWriter::MAX_PAYLOAD
+        || fread(topic, 1, e.id, _f) != e.id || fread(payload, 1, e.value, _f) != e.value)
+      return false;
+    topic[e.id] = '\0';
+    payload[e.value] = '\0';
+    return true;
+  }
+
+private:
+  FILE *_f;
+
+  static inline uint16_t _get16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+  }
+
+  static inline uint32_t _get32(const uint8_t *p) {
+    return _get16(p) | ((uint32_t)_get16(p + 2) << 16);
+  }
+};
+
+#endif /* __TRACE_H__ */
@@ -8,17 +8,63 @@
 #include <ESPmDNS.h>
 #include <WiFiUdp.h>
 #include <ArduinoOTA.h>
+#if defined(USE_OUTBOX_SPILL) || (defined(USE_TRACE) && !defined(POOLSTAT_NATIVE))
+#include <SPIFFS.h>
+#endif
+#if defined(USE_POWER_SAVE) && defined(CONFIG_PM_ENABLE)
+#include <esp_pm.h>
+#endif
+#if defined(USE_POWER_SAVE) && defined(USE_RTOS_TASKS)
+#include <lwip/sockets.h>  // select()
+#endif
 
 #include <U8x8lib.h>
+#include <TextScreen.h>
+#include <LoopTiming.h>
+#include <MemStats.h>
 
 #ifdef USE_ADS1115
+#  ifdef USE_ADS1115_CONTINUOUS
+#include <Wire.h>
+#  else
 #include <Adafruit_ADS1015.h>
-#define THERMISTOR_CONFIG_ADS1115   // Must define before including <Thermistor.h>
+#  endif
 #endif
 
+#include <SPSCQueue.h>
+#include <Log.h>
+#include <MQTTOutbox.h>
+#include <Scheduler.h>
 #include <Thermistor.h>
+#ifdef USE_TRACE
+#include <Trace.h>
+#endif
+#ifdef POOLSTAT_NATIVE
+#include <NativeHAL.h>  // For the control report; see report_print()
+#endif
+#ifdef USE_ADS1115
+#include <ADS1115.h>  // Also has ads1115_pga_t, for single-shot mode
+#endif
+#ifdef USE_I2S_ADC
+#include <I2SADC.h>
+#endif
+#ifdef USE_THERMISTOR_TABLE
+#include <ThermistorTable.h>
+#endif
 
 #include "secrets.h"
+#include "Backoff.h"
+#ifdef HAS_WATER_REFILL
+#include "Debouncer.h"
+#endif
+#include "ReportPolicy.h"
+#ifdef USE_HISTORY
+#include "History.h"
+#endif
+#ifdef USE_TELEMETRY_FRAME
+#include "TelemetryFrame.h"
+#endif
+#include "TopicHash.h"
 
 /***************************************************************************
  *
@@ -32,29 +78,53 @@ static const char* MDNS_HOSTNAME = MQTT_REALM;
 static const char* MQTT_SERVER = "thor.clusterhack.net";
 static const int MQTT_PORT = 1883;
 static const char* MQTT_CLIENT_ID_PREFIX = "poolstat-";
-static const char* MQTT_TOPIC_HEATER_CONTROL = MQTT_REALM "/heater/control";  // W
-static const char* MQTT_TOPIC_RELAY_STATE = MQTT_REALM "/relay/state";  // R 
-static const char* MQTT_TOPIC_RELAY_CONTROL = MQTT_REALM "/relay/control";  // W
-static const char* MQTT_TOPIC_MAIN_TEMP = MQTT_REALM "/main/temperature";  // R
-static const char* MQTT_TOPIC_MAIN_SETPOINT = MQTT_REALM "/main/setpoint";  // W
+static constexpr const char* MQTT_TOPIC_HEATER_CONTROL = MQTT_REALM "/heater/control";  // W
+static constexpr const char* MQTT_TOPIC_RELAY_STATE = MQTT_REALM "/relay/state";  // R 
+static constexpr const char* MQTT_TOPIC_RELAY_CONTROL = MQTT_REALM "/relay/control";  // W
+static constexpr const char* MQTT_TOPIC_MAIN_TEMP = MQTT_REALM "/main/temperature";  // R
+static constexpr const char* MQTT_TOPIC_MAIN_SETPOINT = MQTT_REALM "/main/setpoint";  // W
 #ifdef HAS_HEAT_EXCHANGER
-static const char* MQTT_TOPIC_EXCHANGER_TEMP = MQTT_REALM "/exchanger/temperature";  // R
-static const char* MQTT_TOPIC_EXCHANGER_SETPOINT = MQTT_REALM "/exchanger/setpoint";  // W
+static constexpr const char* MQTT_TOPIC_EXCHANGER_TEMP = MQTT_REALM "/exchanger/temperature";  // R
+static constexpr const char* MQTT_TOPIC_EXCHANGER_SETPOINT = MQTT_REALM "/exchanger/setpoint";  // W
 #endif
 #ifdef HAS_WATER_REFILL
-static const char* MQTT_TOPIC_REFILL_CONTROL = MQTT_REALM "/refill/control";  // W
-static const char* MQTT_TOPIC_VALVE_STATE = MQTT_REALM "/valve/state";  // R
-static const char* MQTT_TOPIC_VALVE_CONTROL = MQTT_REALM "/valve/control";  // R
-static const char* MQTT_TOPIC_WATER_LEVEL = MQTT_REALM "/waterlevel";  // R
+static constexpr const char* MQTT_TOPIC_REFILL_CONTROL = MQTT_REALM "/refill/control";  // W
+static constexpr const char* MQTT_TOPIC_VALVE_STATE = MQTT_REALM "/valve/state";  // R
+static constexpr const char* MQTT_TOPIC_VALVE_CONTROL = MQTT_REALM "/valve/control";  // R
+static constexpr const char* MQTT_TOPIC_WATER_LEVEL = MQTT_REALM "/waterlevel";  // R
+#endif
+#ifdef USE_TELEMETRY_FRAME
+static constexpr const char* MQTT_TOPIC_TELEMETRY = MQTT_REALM "/telemetry";  // R; binary, see TelemetryFrame.h
+#endif
+#ifdef USE_HISTORY
+static constexpr const char* MQTT_TOPIC_HISTORY_QUERY = MQTT_REALM "/history/query";  // W; "<m|h|d> <from_utc> [<to_utc>]"
+static constexpr const char* MQTT_TOPIC_HISTORY_DATA = MQTT_REALM "/history/data";  // R; binary, see History.h
+#endif
+#ifdef USE_LOOP_TIMING
+static constexpr const char* MQTT_TOPIC_DIAG_TIMING = MQTT_REALM "/diag/timing";  // R; "/<task>/<timer>" subtopics
+#endif
+static constexpr const char* MQTT_TOPIC_DIAG_LOG = MQTT_REALM "/diag/log";  // R; up to LOG_MQTT_LEVEL
+#ifdef USE_MEMORY_STATS
+static constexpr const char* MQTT_TOPIC_DIAG_MEMORY = MQTT_REALM "/diag/memory";  // R; JSON
+static constexpr const char* MQTT_TOPIC_DIAG_MEMORY_ALARM = MQTT_REALM "/diag/memory/alarm";  // R; "on" or "off", on change
+#  ifdef USE_MEMORY_SITES
+static constexpr const char* MQTT_TOPIC_DIAG_MEMORY_SITES = MQTT_REALM "/diag/memory/sites";  // R; JSON
+#  endif
 #endif
 
 static const int NTP_TIME_OFFSET = -14400;  // UTC-4 (includes DST)
+static const unsigned long NTP_MIN_VALID_EPOCH = 1577836800;  // 2020-01-01; anything earlier means no sync yet
 
 #ifdef USE_ADS1115
 static const int MAIN_THERMISTOR_CHANNEL = 2;  // on ADS1115
 #  ifdef HAS_HEAT_EXCHANGER
 static const int EXCHANGER_THERMISTOR_CHANNEL = 0;  // on ADS1115
 #  endif
+static const ads1115_pga_t ADS1115_PGA = ADS1115_PGA_4_096V;  // Full-scale range
+#  ifdef USE_ADS1115_CONTINUOUS
+static const ads1115_rate_t ADS1115_DATA_RATE = ADS1115_RATE_128SPS;
+static const int ADS1115_ALERT_PIN = -1;  /* TODO */  // ALERT/RDY; -1 polls on conversion time instead
+#  endif
 #else  // i.e., not USE_ADS1115
 static const int MAIN_THERMISTOR_PIN = 34; // ESP32 pin D34 == A6
 #  ifdef HAS_HEAT_EXCHANGER
@@ -68,6 +138,9 @@ static const adc_attenuation_t ADC_ATTENUATION = ADC_6db;
 //   least at the temperature ranges of interest for pool water...
 //   Rather than debug circuit, this is q uuick-n-dirty workaround.
 static const double ADC_ATTENUATION_FACTOR = 0.60351;
+#  ifdef USE_I2S_ADC
+static const adc_atten_t I2S_ADC_ATTENUATION = ADC_ATTEN_DB_6;  // Same as ADC_ATTENUATION
+#  endif
 #endif  // USE_ADS1115
 
 static const int RELAY_PIN = 4;
@@ -87,19 +160,106 @@ static const float SETPOINT_MAIN_DEFAULT = 87.0;
 static const float SETPOINT_MAIN_OVERSHOOT = 0.5;
 static const float SETPOINT_MAIN_UNDERSHOOT = 0.3;
 #ifdef HAS_HEAT_EXCHANGER 
-static const float SETPONT_EXCHANGER_DEFAULT = 195.0;
+static const float SETPOINT_EXCHANGER_DEFAULT = 195.0;
 static const float SETPOINT_EXCHANGER_OVERSHOOT = 0.5;
 static const float SETPOINT_EXCHANGER_UNDERSHOOT = 1.0;
 #endif
 
-static const int DISPLAY_UPDATE_INTERVAL_SEC = 3;
-static const int MQTT_UPDATE_INTERVAL_SEC = 30;
+static const int DISPLAY_UPDATE_INTERVAL_SEC = 1;  // Cheap; only changed tiles are sent
+// Readings are published on change (see ReportPolicy.h), and re-sent
+// every max interval even if steady; the control side posts a new
+// snapshot on every reading, so that is also how often policies are
+// checked (i.e., min interval is at least THERMOSTAT_UPDATE_INTERVAL_SEC)
+static const float TEMP_REPORT_DEADBAND = 0.2;  // 'F
+static const uint32_t TEMP_REPORT_MIN_INTERVAL_MS = 5000;
+static const uint32_t TEMP_REPORT_MAX_INTERVAL_MS = 300000;
+#ifdef HAS_WATER_REFILL
+static const uint32_t LEVEL_REPORT_MAX_INTERVAL_MS = 300000;
+#endif
 static const int THERMOSTAT_UPDATE_INTERVAL_SEC = 5;
+#ifdef USE_LOOP_TIMING
+static const int DIAG_UPDATE_INTERVAL_SEC = 60;
+#endif
+#ifdef USE_POWER_SAVE
+// WiFi events, MQTT, OTA, NTP, status queue, display flush; with tasks,
+// MQTT traffic also wakes the network task (see _networkIdle())
+static const uint32_t NETWORK_POLL_INTERVAL_MS = 250;
+#else
+static const uint32_t NETWORK_POLL_INTERVAL_MS = 20;
+#endif
+static const uint32_t ADC_SAMPLE_INTERVAL_MS = 5;  // Only while a measurement is in progress
+#if defined(USE_ADS1115_CONTINUOUS) || defined(USE_I2S_ADC)
+// Always, so ADS1115 results stay fresh and the I2S-ADC DMA ring (~50 msec)
+// never wraps around between updates
+static const uint32_t ADC_COLLECT_INTERVAL_MS = 20;
+#endif
+#ifdef HAS_WATER_REFILL
+// Water level switches are read on their edges (see _onLevelEdge()); a
+// new level counts once it has held this long, so splashing does not
+// flicker it.  Both switches closed with mid open is (nearly always)
+// splashing, so it takes longer.  Pins are also re-read every so often,
+// in case an edge was missed.
+static const uint32_t LEVEL_SETTLE_MS = 3000;
+static const uint32_t LEVEL_INVALID_SETTLE_MS = 30000;
+static const uint32_t LEVEL_RESYNC_INTERVAL_MS = 60000;
+#endif
+static const uint32_t MAX_IDLE_MS = 1000;  // Cap on sleep between scheduler passes
+
+#ifdef USE_TRACE
+#  ifdef POOLSTAT_NATIVE
+static const char* TRACE_PATH = "poolstat.trace";  // In the working directory
+static const size_t TRACE_MAX_BYTES = 0;  // No limit
+#  else
+static const char* TRACE_PATH = "/spiffs/trace.bin";  // SPIFFS, via its VFS mount
+static const size_t TRACE_MAX_BYTES = 256 * 1024;  // Ring; ~12KB/hour, so the last 11-22 hours
+#  endif
+static const int TRACE_FLUSH_INTERVAL_SEC = 10;
+#endif
+
+#ifdef USE_MEMORY_STATS
+// Low memory is checked often, but only published once a minute (and
+// whenever the alarm changes).  A reconnect (WiFi association, lwIP
+// socket and buffers, PubSubClient) needs a few KB in one piece, so the
+// alarm goes off well before heap fragmentation gets there.
+static const int MEMORY_CHECK_INTERVAL_SEC = 10;
+static const int MEMORY_PUBLISH_INTERVAL_SEC = 60;
+static const uint32_t MEMORY_ALARM_LARGEST_BLOCK = 16384;
+static const uint32_t MEMORY_ALARM_FREE_HEAP = 32768;
+#endif
+
+#ifdef USE_POWER_SAVE
+// With CONFIG_PM_ENABLE, the clock scales between MIN and MAX, and with
+// tickless idle, the chip light-sleeps whenever both tasks are blocked
+// (see _networkIdle(), control_task()).  The WiFi association is kept
+// in modem sleep: the radio wakes for DTIM beacons only, so traffic from
+// the broker is delayed by up to one DTIM period (typically 1-3 beacons,
+// i.e., ~100-300 msec).  A relay command thus reaches the relay within
+// 500 msec with tasks; without them, add NETWORK_POLL_INTERVAL_MS.  The
+// on-device part (MQTT callback to relay) is published as the
+// "command_latency" timer, under diag.
+static const int POWER_MAX_CPU_FREQ_MHZ = 160;
+static const int POWER_MIN_CPU_FREQ_MHZ = 80;  // Also the fixed clock, without CONFIG_PM_ENABLE
+#endif
+
+#ifdef USE_RTOS_TASKS
+// Sensing and control run in their own task, pinned to the APP core and
+// at a priority above everything else there, so relay decisions do not
+// wait on the network; WiFi, MQTT, OTA and the display run in a task on
+// the PRO core, alongside the WiFi/lwIP tasks.  Each task sleeps until
+// its next job is due (see Scheduler.h); commands wake the control task
+// right away (see _postCommand()).
+static const BaseType_t CONTROL_TASK_CORE = 1;
+static const UBaseType_t CONTROL_TASK_PRIORITY = 5;
+static const uint32_t CONTROL_TASK_STACK_SIZE = 4096;
+static const BaseType_t NETWORK_TASK_CORE = 0;
+static const UBaseType_t NETWORK_TASK_PRIORITY = 1;
+static const uint32_t NETWORK_TASK_STACK_SIZE = 8192;
+#endif
 
 // TODO Use u8x8.get{Rows,Cols}()
-// TODO the "16" is implicitly hardcoded in several places below
 static const int DISPLAY_WIDTH_CHARS = 16;
 static const int DISPLAY_HEIGHT_CHARS = 4;
+static const uint8_t *const DISPLAY_FONT = u8x8_font_pxplusibmcgathin_f;  // 1x1 tiles (see TextScreen.h)
 
 /***************************************************************************
  *
@@ -108,6 +268,53 @@ static const int DISPLAY_HEIGHT_CHARS = 4;
 static WiFiClient mqttWifiClient;
 static PubSubClient mqttClient(mqttWifiClient);
 
+// Outgoing messages are queued while the broker is unreachable, and
+// replayed (with their original timestamps) once it is back
+static const uint16_t MQTT_OUTBOX_SIZE = 64;  // ~16min of readings
+static const uint16_t MQTT_OUTBOX_FLUSH_BATCH = 8;  // Max messages per loop pass
+#ifdef USE_OUTBOX_SPILL
+static const char* MQTT_OUTBOX_SPILL_PATH = "/outbox.bin";
+static const size_t MQTT_OUTBOX_SPILL_MAX_BYTES = 64 * 1024;
+#endif
+static MQTTOutbox<MQTT_OUTBOX_SIZE> mqttOutbox(mqttClient);
+
+#ifdef USE_TELEMETRY_FRAME
+// Readings are batched here instead of the outbox; while disconnected,
+// a frame carries up to TELEMETRY_FRAME_RECORDS of them
+static const uint16_t TELEMETRY_QUEUE_SIZE = 128;  // 1.3KB
+static const uint8_t TELEMETRY_FRAME_RECORDS = 16;
+
+static const uint8_t TELEMETRY_CHANNELS = TELEMETRY_MAIN_TEMP | TELEMETRY_RELAY
+#  ifdef HAS_HEAT_EXCHANGER
+  | TELEMETRY_EXCHANGER_TEMP
+#  endif
+#  ifdef HAS_WATER_REFILL
+  | TELEMETRY_WATER_LEVEL | TELEMETRY_VALVE
+#  endif
+  ;
+
+typedef TelemetryBatch<TELEMETRY_QUEUE_SIZE, TELEMETRY_FRAME_RECORDS> Telemetry;
+static Telemetry telemetry(TELEMETRY_CHANNELS);
+
+// Fixed header, topic length and topic, plus frame
+static_assert(5 + 2 + sizeof(MQTT_REALM "/telemetry") - 1 + Telemetry::MAX_FRAME_SIZE <= MQTT_MAX_PACKET_SIZE,
+  "Telemetry frame does not fit in PubSubClient buffer; lower TELEMETRY_FRAME_RECORDS");
+#endif
+
+#ifdef USE_HISTORY
+// Closed buckets kept per resolution; about 6KB in all.  A query reply
+// goes out a few frames per network pass, so it does not hold up the rest.
+static const uint16_t HISTORY_MINUTES = 120;  // 2 hours
+static const uint16_t HISTORY_HOURS = 72;  // 3 days
+static const uint16_t HISTORY_DAYS = 62;  // 2 months
+static const uint8_t HISTORY_FRAMES_PER_POLL = 2;
+
+typedef History<HISTORY_MINUTES, HISTORY_HOURS, HISTORY_DAYS> PoolHistory;
+
+static_assert(5 + 2 + sizeof(MQTT_REALM "/history/data") - 1 + PoolHistory::MAX_FRAME_SIZE <= MQTT_MAX_PACKET_SIZE,
+  "History frame does not fit in PubSubClient buffer; lower History::MAX_PER_FRAME");
+#endif
+
 static WiFiUDP ntpWifiUDP;
 static NTPClient ntpClient(ntpWifiUDP);
 
@@ -115,6 +322,11 @@ static NTPClient ntpClient(ntpWifiUDP);
 RemoteDebug rdbg;
 #endif
 
+// Log messages (see Log.h) from either task wait here, until the network
+// side writes them out (see log_update())
+static const uint8_t LOG_RING_SIZE = 32;  // Lines; ~3KB
+static LogRing<LOG_RING_SIZE> logRing;
+
 
 U8X8_SSD1306_128X32_UNIVISION_HW_I2C u8x8(  /* TODO? */
   U8X8_PIN_NONE,  // reset 
@@ -122,53 +334,186 @@ U8X8_SSD1306_128X32_UNIVISION_HW_I2C u8x8(  /* TODO? */
   SDA  // data
 );
 
+// Everything draws here; display_update() sends what changed to u8x8
+static TextScreen<DISPLAY_WIDTH_CHARS, DISPLAY_HEIGHT_CHARS> screen(DISPLAY_FONT);
+
 #ifdef USE_ADS1115
+#  ifdef USE_ADS1115_CONTINUOUS
+static ADS1115Continuous ads1115;
+#  else
 static Adafruit_ADS1115 ads1115;
+#  endif
+#endif
+#ifdef USE_I2S_ADC
+static I2SADCSampler i2sAdc;
 #endif
 
-#ifdef USE_ADS1115
-static ADS1115Port _mainThermistorPort(ads1115, MAIN_THERMISTOR_CHANNEL);
+// Numeric type for thermistor sampling and conversion (see Thermistor.h)
+#ifdef USE_FIXED_POINT
+typedef q16_16_t sensor_value_t;
+#else
+typedef float sensor_value_t;
+#endif
+
+#ifdef USE_THERMISTOR_TABLE
+typedef TableThermistor<UNIT_FAHRENHEIT, 7, sensor_value_t> PoolThermistor;
+#else
+typedef BasicThermistor<sensor_value_t> PoolThermistor;
+#endif
+
+#if defined(USE_ADS1115_CONTINUOUS)
+static ADS1115ChannelPort<sensor_value_t> _mainThermistorPort(ads1115, MAIN_THERMISTOR_CHANNEL);
+#elif defined(USE_ADS1115)
+static BasicADS1115Port<sensor_value_t> _mainThermistorPort(ads1115, MAIN_THERMISTOR_CHANNEL);
+#elif defined(USE_I2S_ADC)
+static I2SADCPort<sensor_value_t> _mainThermistorPort(i2sAdc, MAIN_THERMISTOR_PIN, sensor_value_t(ADC_ATTENUATION_FACTOR));
 #else
-static MCUPort _mainThermistorPort(MAIN_THERMISTOR_PIN, ADC_ATTENUATION_FACTOR);
+static BasicMCUPort<sensor_value_t> _mainThermistorPort(MAIN_THERMISTOR_PIN, sensor_value_t(ADC_ATTENUATION_FACTOR));
 #endif
-static Thermistor mainTemperatureSensor(_mainThermistorPort, 10000.0, 10000.0, 25.0, 3950.0, 0.98);
+static PoolThermistor mainTemperatureSensor(_mainThermistorPort, 10000.0, 10000.0, 25.0, 3950.0, 0.98);
 
 #ifdef HAS_HEAT_EXCHANGER
-#  ifdef USE_ADS1115
-static ADS1115Port _exchangerThermistorPort(ads1115, EXCHANGER_THERMISTOR_CHANNEL);
+#  if defined(USE_ADS1115_CONTINUOUS)
+static ADS1115ChannelPort<sensor_value_t> _exchangerThermistorPort(ads1115, EXCHANGER_THERMISTOR_CHANNEL);
+#  elif defined(USE_ADS1115)
+static BasicADS1115Port<sensor_value_t> _exchangerThermistorPort(ads1115, EXCHANGER_THERMISTOR_CHANNEL);
+#  elif defined(USE_I2S_ADC)
+static I2SADCPort<sensor_value_t> _exchangerThermistorPort(i2sAdc, EXCHANGER_THERMISTOR_PIN, sensor_value_t(ADC_ATTENUATION_FACTOR));
 #  else
-static MCUPort _exchangerThermistorPort(EXCHANGER_THERMISTOR_PIN, ADC_ATTENUATION_FACTOR);
+static BasicMCUPort<sensor_value_t> _exchangerThermistorPort(EXCHANGER_THERMISTOR_PIN, sensor_value_t(ADC_ATTENUATION_FACTOR));
+#  endif
+static PoolThermistor exchangerTemperatureSensor(_exchangerThermistorPort, 10000.0, 10000.0, 25.0, 3950.0, 0.98);
+#endif
+
+#ifdef USE_ADC_FILTER
+// Standard error target, in ADC ratio units; ~0.1'F near 85'F.  See
+// bench/bench_filter.cpp for conversions per reading vs error.
+static const float ADC_FILTER_TOLERANCE = 0.0006;
+static AdaptiveFilter<sensor_value_t> _mainThermistorFilter(ADC_FILTER_TOLERANCE);
+#  ifdef HAS_HEAT_EXCHANGER
+static AdaptiveFilter<sensor_value_t> _exchangerThermistorFilter(ADC_FILTER_TOLERANCE);
 #  endif
-static Thermistor exchangerTemperatureSensor(_exchangerThermistorPort, 10000.0, 10000.0, 25.0, 3950.0, 0.98);
 #endif
 
+static ADCSampler adcSampler;
+
 /***************************************************************************
- *
+ * Timing instrumentation (see LoopTiming.h); TIMED() and TIME_SCOPE()
+ * compile to nothing without USE_LOOP_TIMING
  ***************************************************************************/
 
-typedef enum { CONTROL_OFF, CONTROL_MANUAL, CONTROL_AUTO } control_state_t;
+#ifdef USE_LOOP_TIMING
+// Timers are per task; the first of each covers a whole pass, so its
+// count also gives the loop rate
+// (except TIMER_COMMAND_LATENCY, which is from MQTT callback to command
+// execution, across tasks)
+typedef enum {
+  TIMER_CONTROL_PASS, TIMER_COMMAND, TIMER_COMMAND_LATENCY, TIMER_ADC, TIMER_THERMOSTAT,
+#ifdef HAS_WATER_REFILL
+  TIMER_REFILL,
+#endif
+  NUM_CONTROL_TIMERS
+} control_timer_t;
 
-static control_state_t _parseControlState(String state) {
-  if (state == "on" || state == "auto") {
-    return CONTROL_AUTO;
-  } else if (state == "manual") {
-    return CONTROL_MANUAL;
-  } 
-  return CONTROL_OFF;
+static const char* const CONTROL_TIMER_NAMES[NUM_CONTROL_TIMERS] = {
+  "pass", "command", "command_latency", "adc", "thermostat",
+#ifdef HAS_WATER_REFILL
+  "refill",
+#endif
+};
+
+typedef enum {
+  TIMER_NETWORK_PASS, TIMER_WIFI, TIMER_MQTT_CONNECT, TIMER_NTP, TIMER_OTA, TIMER_MQTT_LOOP,
+  TIMER_OUTBOX, TIMER_STATUS, TIMER_DISPLAY, TIMER_MQTT_VALUES,
+  NUM_NETWORK_TIMERS
+} network_timer_t;
+
+static const char* const NETWORK_TIMER_NAMES[NUM_NETWORK_TIMERS] = {
+  "pass", "wifi", "mqtt_connect", "ntp", "ota", "mqtt_loop",
+  "outbox", "status", "display", "mqtt_values",
+};
+
+static TimingGroup<NUM_CONTROL_TIMERS> controlTiming;
+static TimingGroup<NUM_NETWORK_TIMERS> networkTiming;
+#endif
+
+/***************************************************************************
+ * Allocation counts per call site (see MemStats.h), in debug builds;
+ * MEM_SITE() compiles to nothing without USE_MEMORY_SITES
+ ***************************************************************************/
+
+#ifdef USE_MEMORY_SITES
+// All on the network side; allocations elsewhere (e.g., the WiFi and
+// lwIP tasks) are not counted
+typedef enum {
+  MEM_SITE_WIFI_CONNECT, MEM_SITE_MQTT_CONNECT, MEM_SITE_MQTT_CALLBACK, MEM_SITE_STATUS, MEM_SITE_DISPLAY,
+  NUM_MEM_SITES
+} mem_site_t;
+
+static const char* const MEM_SITE_NAMES[NUM_MEM_SITES] = {
+  "wifi_connect", "mqtt_connect", "mqtt_callback", "status", "display",
+};
+
+static uint32_t memSites[NUM_MEM_SITES];  // Since boot
+
+#  ifdef POOLSTAT_NATIVE
+static void _countAllocation(size_t) {
+  MemSite::count();
+}
+#  else
+// Every heap allocation (String, operator new, ...) ends up in one of
+// these; the linker redirects calls to them here (--wrap, see the
+// memdebug environment in platformio.ini)
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+void *__wrap_malloc(size_t size) {
+  MemSite::count();
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+  MemSite::count();
+  return __real_calloc(n, size);
 }
 
+void *__wrap_realloc(void *p, size_t size) {
+  MemSite::count();
+  return __real_realloc(p, size);
+}
+}
+#  endif
+#endif
+
+/***************************************************************************
+ * Job scheduling (see Scheduler.h), one scheduler per task; jobs are
+ * registered by the *_setup() functions
+ ***************************************************************************/
+
+static Scheduler<8> controlScheduler;
+static Scheduler<12> networkScheduler;
+
+/***************************************************************************
+ *
+ ***************************************************************************/
+
+typedef enum { CONTROL_OFF, CONTROL_MANUAL, CONTROL_AUTO } control_state_t;
+
 static control_state_t heaterControl = CONTROL_OFF;
 #ifdef HAS_WATER_REFILL
 static control_state_t refillControl = CONTROL_OFF;
 #endif
 
-static double mainTemperature;
-static double mainSetpointHi = SETPOINT_MAIN_DEFAULT + SETPOINT_MAIN_OVERSHOOT;
-static double mainSetpointLo = SETPOINT_MAIN_DEFAULT - SETPOINT_MAIN_UNDERSHOOT;
+static bool hasReadings = false;  // Until first thermostat reading
+static float mainTemperature;
+static float mainSetpointHi = SETPOINT_MAIN_DEFAULT + SETPOINT_MAIN_OVERSHOOT;
+static float mainSetpointLo = SETPOINT_MAIN_DEFAULT - SETPOINT_MAIN_UNDERSHOOT;
 #ifdef HAS_HEAT_EXCHANGER
-static double exchangerTemperature;
-static double exchangerSetpointHi = SETPOINT_EXCHANGER_DEFAULT + SETPOINT_EXCHANGER_OVERSHOOT;
-static double exchangerSetpointLo = SETPOINT_EXCHANGER_DEFAULT - SETPOINT_EXCHANGER_UNDERSHOOT;
+static float exchangerTemperature;
+static float exchangerSetpointHi = SETPOINT_EXCHANGER_DEFAULT + SETPOINT_EXCHANGER_OVERSHOOT;
+static float exchangerSetpointLo = SETPOINT_EXCHANGER_DEFAULT - SETPOINT_EXCHANGER_UNDERSHOOT;
 #endif
 
 #ifdef HAS_WATER_REFILL
@@ -176,22 +521,246 @@ typedef enum { LEVEL_LO, LEVEL_MID, LEVEL_HI, LEVEL_INVALID } level_t;
 static level_t waterLevel;
 #endif
 
+/***************************************************************************
+ * Handoff between control and network sides.  The state above is owned
+ * by the control side; everything crosses over via SPSC queues only.
+ ***************************************************************************/
+
+// Commands, from MQTT to the thermostat/refill logic
+typedef enum {
+  CMD_HEATER_CONTROL, CMD_RELAY, CMD_MAIN_SETPOINT,
+#ifdef HAS_HEAT_EXCHANGER
+  CMD_EXCHANGER_SETPOINT,
+#endif
+#ifdef HAS_WATER_REFILL
+  CMD_REFILL_CONTROL, CMD_VALVE,
+#endif
+} command_type_t;
+
+typedef struct {
+  command_type_t type;
+  uint32_t posted;  // micros(), for latency stats
+  union {
+    control_state_t state;  // CMD_*_CONTROL
+    bool on;  // CMD_RELAY, CMD_VALVE
+    float value;  // CMD_*_SETPOINT
+  };
+} command_t;
+
+// Snapshot of control state, for publishing and display; event is what
+// prompted it (relay and valve transitions are published immediately)
+typedef enum { STATUS_READINGS, STATUS_RELAY, STATUS_VALVE } status_event_t;
+
+typedef struct {
+  status_event_t event;
+  bool hasReadings;
+  float mainTemperature;
+  float mainSetpointHi, mainSetpointLo;
+#ifdef HAS_HEAT_EXCHANGER
+  float exchangerTemperature;
+#endif
+#ifdef HAS_WATER_REFILL
+  level_t waterLevel;
+  bool valveOn;
+#endif
+  bool relayOn;
+} status_t;
+
+static SPSCQueue<command_t, 8> commandQueue;  // Network -> control
+static SPSCQueue<status_t, 16> statusQueue;  // Control -> network
+
+// Network side's copy of the latest control state
+static status_t controlStatus;
+
+static inline bool _getRelayOn();
+#ifdef HAS_WATER_REFILL
+static inline bool _getValveOn();
+#endif
+
+// Control side
+static void _postStatus(status_event_t event) {
+  status_t s;
+  s.event = event;
+  s.hasReadings = hasReadings;
+  s.mainTemperature = mainTemperature;
+  s.mainSetpointHi = mainSetpointHi;
+  s.mainSetpointLo = mainSetpointLo;
+#ifdef HAS_HEAT_EXCHANGER
+  s.exchangerTemperature = exchangerTemperature;
+#endif
+#ifdef HAS_WATER_REFILL
+  s.waterLevel = waterLevel;
+  s.valveOn = _getValveOn();
+#endif
+  s.relayOn = _getRelayOn();
+  if (!statusQueue.push(s)) {
+    LOG_W(SYSTEM, "Status queue full, dropped update");
+  }
+}
+
+#ifdef USE_RTOS_TASKS
+static TaskHandle_t controlTask = NULL;
+static TaskHandle_t networkTask = NULL;  // For its stack high-water mark
+#endif
+
+// Network side
+static void _postCommand(command_t& cmd) {
+  cmd.posted = micros();
+  if (!commandQueue.push(cmd)) {
+    LOG_W(MQTT, "Command queue full, dropped command %d", (int)cmd.type);
+    return;
+  }
+#ifdef USE_RTOS_TASKS
+  if (controlTask)
+    xTaskNotifyGive(controlTask);  // Don't wait for its next deadline
+#endif
+}
+
+/***************************************************************************
+ * Input trace (see Trace.h), for replay with the native build; control
+ * side inputs cross over via a queue, and the network side writes them
+ ***************************************************************************/
+
+#ifdef USE_TRACE
+static TraceWriter trace;
+static SPSCQueue<trace_event_t, 64> traceQueue;  // Control -> network
+
+// Control side; best effort
+static void _traceEvent(trace_type_t type, uint8_t id, uint16_t value) {
+  trace_event_t e = { (uint32_t)millis(), type, id, value };
+  traceQueue.push(e);
+}
+
+// ADC code hook; tag is the pin (or ADS1115 channel)
+static void _traceCode(uint8_t tag, int32_t code) {
+#  ifdef USE_ADS1115
+  _traceEvent(TRACE_ADS1115, tag, (uint16_t)code);
+#  else
+  _traceEvent(TRACE_ADC, tag, (uint16_t)code);
+#  endif
+}
+
+// Only level changes are recorded
+static void _tracePin(uint8_t pin, int level) {
+  static uint64_t traced = 0, levels = 0;
+  uint64_t bit = 1ULL << pin;
+  if ((traced & bit) && !(levels & bit) == !level)
+    return;
+  traced |= bit;
+  levels = level ? (levels | bit) : (levels & ~bit);
+  _traceEvent(TRACE_PIN, pin, level);
+}
+
+// Network side, from network_poll()
+static void trace_update() {
+  trace_event_t e;
+  while (traceQueue.pop(e))
+    trace.write(e);
+}
+
+// Periodic job
+static void trace_flush() {
+  trace.flush();
+}
+
+static void trace_setup() {
+#  ifndef POOLSTAT_NATIVE
+  if (!SPIFFS.begin(true)) {
+    LOG_E(TRACE, "SPIFFS mount failed, no input trace");
+    return;
+  }
+#  endif
+  if (!trace.begin(TRACE_PATH, TRACE_MAX_BYTES)) {
+    LOG_E(TRACE, "Cannot write input trace to %s", TRACE_PATH);
+    return;
+  }
+#  ifdef USE_ADS1115
+  _mainThermistorPort.setCodeHook(_traceCode, MAIN_THERMISTOR_CHANNEL);
+#    ifdef HAS_HEAT_EXCHANGER
+  _exchangerThermistorPort.setCodeHook(_traceCode, EXCHANGER_THERMISTOR_CHANNEL);
+#    endif
+#  else
+  _mainThermistorPort.setCodeHook(_traceCode, MAIN_THERMISTOR_PIN);
+#    ifdef HAS_HEAT_EXCHANGER
+  _exchangerThermistorPort.setCodeHook(_traceCode, EXCHANGER_THERMISTOR_PIN);
+#    endif
+#  endif
+  networkScheduler.every(TRACE_FLUSH_INTERVAL_SEC * 1000, trace_flush, TRACE_FLUSH_INTERVAL_SEC * 1000);
+  LOG_I(TRACE, "Recording input trace to %s", TRACE_PATH);
+}
+#endif
+
+/***************************************************************************
+ * Control report, printed when the native driver exits (e.g., after
+ * replaying a trace, to compare changes across commits).  Step costs are
+ * host CPU time, since virtual time stands still while code runs.
+ ***************************************************************************/
+
+#ifdef POOLSTAT_NATIVE
+static struct {
+  unsigned relayCycles;  // Off to on
+  unsigned long readings;  // In auto mode, where error counts
+  unsigned long inBand;
+  double errorSum, errorSqSum, errorMax;  // 'F, from main setpoint
+  NativeHAL::WallCost thermostat, refill, command;
+} report;
+
+#  define REPORT_COST(cost)  NativeHAL::WallTimer _reportTimer(report.cost)
+
+static void _reportReading() {
+  float setpoint = mainSetpointLo + SETPOINT_MAIN_UNDERSHOOT;
+  double error = mainTemperature - setpoint;
+  report.readings++;
+  report.errorSum += error;
+  report.errorSqSum += error * error;
+  report.errorMax = max(report.errorMax, fabs(error));
+  if (mainTemperature >= mainSetpointLo && mainTemperature <= mainSetpointHi)
+    report.inBand++;
+}
+
+static void _reportCost(const char *name, const NativeHAL::WallCost &cost) {
+  fprintf(stderr, "REPORT: %s %lu steps, %.1f ns/step\n",
+    name, cost.count, cost.count ? (double)cost.ns / cost.count : 0.0);
+}
+
+static void report_print() {
+  unsigned long n = report.readings;
+  fprintf(stderr, "REPORT: relay %u cycles, %lu readings in auto\n", report.relayCycles, n);
+  if (n > 0) {
+    fprintf(stderr, "REPORT: setpoint error mean %+.3f, rms %.3f, max %.3f 'F, %.1f%% in band\n",
+      report.errorSum / n, sqrt(report.errorSqSum / n), report.errorMax, 100.0 * report.inBand / n);
+  }
+  _reportCost("thermostat", report.thermostat);
+#  ifdef HAS_WATER_REFILL
+  _reportCost("refill", report.refill);
+#  endif
+  _reportCost("command", report.command);
+}
+#else
+#  define REPORT_COST(cost)
+static inline void _reportReading() { }
+#endif
+
 /***************************************************************************
  *
  ***************************************************************************/
 
 static void _setRelayOn(bool on, bool publish = true) {
+#ifdef POOLSTAT_NATIVE
+  if (on && !_getRelayOn())
+    report.relayCycles++;
+#endif
   if (on) {
     digitalWrite(RELAY_PIN, HIGH);
     if (publish) {
-      mqttClient.publish(MQTT_TOPIC_RELAY_STATE, "on");
-      DEBUG_MSG("Heater relay ON");
+      _postStatus(STATUS_RELAY);
+      LOG_I(THERMOSTAT, "Heater relay ON");
     }
   } else {
     digitalWrite(RELAY_PIN, LOW);
     if (publish) {
-      mqttClient.publish(MQTT_TOPIC_RELAY_STATE, "off");
-      DEBUG_MSG("Heater relay OFF");
+      _postStatus(STATUS_RELAY);
+      LOG_I(THERMOSTAT, "Heater relay OFF");
     }
   }
 }
@@ -205,14 +774,14 @@ static void _setValveOn(bool on, bool publish = true) {
   if (on) {
     digitalWrite(VALVE_PIN, HIGH);
     if (publish) {
-      mqttClient.publish(MQTT_TOPIC_VALVE_STATE, "on");
-      DEBUG_MSG("Valve ON");
+      _postStatus(STATUS_VALVE);
+      LOG_I(REFILL, "Valve ON");
     }
   } else {
     digitalWrite(VALVE_PIN, LOW);
     if (publish) {
-      mqttClient.publish(MQTT_TOPIC_VALVE_STATE, "off");
-      DEBUG_MSG("Valve OFF");
+      _postStatus(STATUS_VALVE);
+      LOG_I(REFILL, "Valve OFF");
     }
   }
 }
@@ -225,91 +794,156 @@ static inline bool _getValveOn() {
  *
  ***************************************************************************/
 
+// Periodic job; only draws into the framebuffer, network_poll() flushes it
+static void display_update() {
+  TIME_SCOPE(networkTiming, TIMER_DISPLAY);
+  MEM_SITE(memSites[MEM_SITE_DISPLAY]);
+
+  // Temperature and relay status
+  bool relayOn = controlStatus.relayOn;
+  screen.clearLine(0);
+#ifdef HAS_WATER_REFILL
+  screen.printf(2, 0, "%4.1f'F H%c V%c", controlStatus.mainTemperature, relayOn ? '+' : '_', controlStatus.valveOn ? '+' : '_');
+#else
+  screen.printf(4, 0, "%4.1f'F H%c", controlStatus.mainTemperature, relayOn ? '+' : '_');
+#endif
+  screen.clearLine(1);
+  screen.printf(3, 1, "SET: %4.1f'F", relayOn ? controlStatus.mainSetpointHi : controlStatus.mainSetpointLo);
+
+  // Current time
+  screen.clearLine(3);
+  screen.printf(5, 3, "%02d:%02d", ntpClient.getHours(), ntpClient.getMinutes());
+}
+
 static void display_setup() {
   u8x8.begin();
   u8x8.setFlipMode(1);
   u8x8.setPowerSave(0);
   //u8x8.setFont(u8x8_font_chroma48medium8_r);
-  u8x8.setFont(u8x8_font_pxplusibmcgathin_f);
+  u8x8.setFont(DISPLAY_FONT);  // Same as screen's
 
   // TODO - "HELLO!" message?
 
-  DEBUG_MSG("Display ready");
+  networkScheduler.every(DISPLAY_UPDATE_INTERVAL_SEC * 1000, display_update, DISPLAY_UPDATE_INTERVAL_SEC * 1000);
+
+  LOG_I(SYSTEM, "Display ready");
 }
 
-static unsigned long display_last_update = millis();
-static void display_update() {
-  if (millis() - display_last_update < DISPLAY_UPDATE_INTERVAL_SEC * 1000)
-    return;
+// Connection attempts back off exponentially, with random jitter
+static const uint32_t WIFI_BACKOFF_MIN_MS = 1000;
+static const uint32_t WIFI_BACKOFF_MAX_MS = 60000;
+static const uint32_t WIFI_CONNECT_TIMEOUT_MS = 15000;
 
-  display_last_update = millis();
+typedef enum { WIFI_STATE_IDLE, WIFI_STATE_CONNECTING, WIFI_STATE_CONNECTED, WIFI_STATE_BACKOFF } wifi_state_t;
 
-  // Temperature and relay status
-  bool relayOn = _getRelayOn();
-  u8x8.clearLine(0);
-#ifdef HAS_WATER_REFILL
-  u8x8.setCursor(2, 0);
-  u8x8.printf("%4.1f'F H%c V%c", mainTemperature, relayOn ? '+' : '_', _getValveOn() ? '+' : '_');
-#else
-  u8x8.setCursor(4, 0);
-  u8x8.printf("%4.1f'F H%c", mainTemperature, relayOn ? '+' : '_');
-#endif
-  u8x8.clearLine(1);
-  u8x8.setCursor(3, 1);
-  u8x8.printf("SET: %4.1f'F", relayOn ? mainSetpointHi : mainSetpointLo);
+static wifi_state_t wifiState = WIFI_STATE_IDLE;
+static Backoff wifiBackoff(WIFI_BACKOFF_MIN_MS, WIFI_BACKOFF_MAX_MS);
+static job_id_t wifiRetryJob, wifiTimeoutJob;  // One-shot
 
-  // Current time
-  u8x8.clearLine(3);
-  u8x8.setCursor(5, 3);
-  u8x8.printf("%02d:%02d", ntpClient.getHours(), ntpClient.getMinutes());
-}
+// WiFi events are raised in the system event task; hand them over to
+// the network side
+static SPSCQueue<WiFiEvent_t, 8> wifiEventQueue;
 
-static const int WIFI_CONNECT_RETRY_INTERVAL_SEC = 5;
+static void wifi_event(WiFiEvent_t event) {
+  if (event == SYSTEM_EVENT_STA_GOT_IP || event == SYSTEM_EVENT_STA_DISCONNECTED)
+    wifiEventQueue.push(event);
+}
 
-static unsigned long wifi_last_reconnect = millis();
-static void wifi_reconnect(bool force = false) {
-  unsigned long now = millis();
-  if (now - wifi_last_reconnect < WIFI_CONNECT_RETRY_INTERVAL_SEC * 1000 && !force)
-    return;
-  wifi_last_reconnect = now;
+static void network_on_connect();  // Re-arms services; see below
 
-  DEBUG_MSG("WiFi connecting to %s ", WIFI_SSID);
+static void _wifiBegin(unsigned long now) {
+  LOG_I(WIFI, "Connecting to %s", WIFI_SSID);
   // Display output
-  u8x8.clearDisplay();
-  u8x8.setCursor(0, 0);
-  u8x8.printf("WiFi connecting");
-  u8x8.setCursor(max(0, (DISPLAY_WIDTH_CHARS-(int)strlen(WIFI_SSID))/2), 1);
-  u8x8.printf(WIFI_SSID);
+  screen.clear();
+  screen.printCentered(0, "WiFi connecting");
+  screen.printCentered(1, WIFI_SSID);
 
   WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
-  
-  if (WiFi.waitForConnectResult() == WL_CONNECTED) {
-    DEBUG_MSG("WiFi connected");
-
-    String ip = WiFi.localIP().toString();
-    DEBUG_MSG("IP address: %s", ip.c_str());
-    // Display output
-    u8x8.clearLine(0);
-    u8x8.setCursor(1, 0);
-    u8x8.printf("WiFi connected");
-    u8x8.setCursor(max(0, (DISPLAY_WIDTH_CHARS-(int)ip.length())/2), 2);
-    u8x8.printf(ip.c_str());   
+  wifiState = WIFI_STATE_CONNECTING;
+  networkScheduler.start(wifiTimeoutJob, WIFI_CONNECT_TIMEOUT_MS, now);
+}
+
+static void _wifiBackoff(unsigned long now) {
+  uint32_t wait = wifiBackoff.fail();
+  wifiState = WIFI_STATE_BACKOFF;
+  networkScheduler.start(wifiRetryJob, wait, now);
+  LOG_I(WIFI, "Retry in %u ms", (unsigned)wait);
+}
+
+static void _wifiConnected() {
+  MEM_SITE(memSites[MEM_SITE_WIFI_CONNECT]);
+  LOG_I(WIFI, "Connected");
+
+  IPAddress addr = WiFi.localIP();
+  char ip[16];
+  snprintf(ip, sizeof(ip), "%u.%u.%u.%u", addr[0], addr[1], addr[2], addr[3]);
+  LOG_I(WIFI, "IP address: %s", ip);
+  // Display output
+  screen.printCentered(0, "WiFi connected");
+  screen.printCentered(2, ip);
+
+  wifiState = WIFI_STATE_CONNECTED;
+  networkScheduler.stop(wifiTimeoutJob);
+  wifiBackoff.reset();
+  network_on_connect();
+}
+
+static void _wifiFailed(unsigned long now) {
+  if (wifiState == WIFI_STATE_CONNECTED) {
+    LOG_W(WIFI, "Connection lost");
   } else {
-    DEBUG_MSG("WiFi connection failed!");
-    u8x8.clearLine(0);
-    u8x8.setCursor(3, 0);
-    u8x8.printf("WiFi failed");
+    LOG_W(WIFI, "Connection failed");
+  }
+  screen.printCentered(0, "WiFi failed");
+  networkScheduler.stop(wifiTimeoutJob);
+  _wifiBackoff(now);
+}
+
+// One-shot jobs
+static void _wifiRetry() {
+  _wifiBegin(millis());
+}
+
+static void _wifiTimeout() {
+  WiFi.disconnect();
+  _wifiFailed(millis());
+}
+
+// Never blocks: connection progress arrives via wifi_event(), and
+// timeouts and retries are scheduled jobs
+static void wifi_update() {
+  unsigned long now = millis();
+
+  WiFiEvent_t event;
+  while (wifiEventQueue.pop(event)) {
+    if (event == SYSTEM_EVENT_STA_GOT_IP && wifiState == WIFI_STATE_CONNECTING) {
+      _wifiConnected();
+    } else if (event == SYSTEM_EVENT_STA_DISCONNECTED &&
+               (wifiState == WIFI_STATE_CONNECTING || wifiState == WIFI_STATE_CONNECTED)) {
+      _wifiFailed(now);
+    }
+    // else, stale event (e.g., from our own disconnect() after a timeout)
   }
 }
 
+static inline bool wifi_connected() {
+  return wifiState == WIFI_STATE_CONNECTED;
+}
+
 static void wifi_setup() {
   WiFi.persistent(false);
   //WiFi.setAutoConnect(false);
   WiFi.setAutoReconnect(false);
   WiFi.mode(WIFI_STA);
+  WiFi.onEvent(wifi_event);
+#ifdef USE_POWER_SAVE
+  WiFi.setSleep(true);  // Modem sleep; keeps association
+#endif
+  wifiRetryJob = networkScheduler.add(_wifiRetry);
+  wifiTimeoutJob = networkScheduler.add(_wifiTimeout);
 
   delay(100);
-  wifi_reconnect(true);
+  _wifiBegin(millis());  // Start first connection attempt
 }
 
 static void ota_setup() {
@@ -319,144 +953,238 @@ static void ota_setup() {
   // From BasicOTA example code
   ArduinoOTA
     .onStart([]() {
-      String type;
-      if (ArduinoOTA.getCommand() == U_FLASH)
-        type = "sketch";
-      else // U_SPIFFS
-        type = "filesystem";
+      const char *type = (ArduinoOTA.getCommand() == U_FLASH) ? "sketch" : "filesystem";  // else U_SPIFFS
 
       // TODO if updating SPIFFS this would be the place to unmount SPIFFS using SPIFFS.end()
-      DEBUG_BEGINGROUP;
-      DEBUG_PRINT("OTA start: " + type);
-      DEBUG_ENDGROUP;
+      LOG_I(OTA, "Start: %s", type);
     })
     .onEnd([]() {
-      DEBUG_MSG("End\n");
+      LOG_I(OTA, "End");
     })
     .onProgress([](unsigned int progress, unsigned int total) {
-      DEBUG_MSG("OTA progress: %u%%\r", (progress / (total / 100)));
+      LOG_D(OTA, "Progress: %u%%", (progress / (total / 100)));
     })
     .onError([](ota_error_t error) {
-      DEBUG_BEGINGROUP;
-      DEBUG_PRINTF("OTA error[%u]: ", error);
-      if (error == OTA_AUTH_ERROR) DEBUG_PRINT("Auth Failed");
-      else if (error == OTA_BEGIN_ERROR) DEBUG_PRINT("Begin Failed");
-      else if (error == OTA_CONNECT_ERROR) DEBUG_PRINT("Connect Failed");
-      else if (error == OTA_RECEIVE_ERROR) DEBUG_PRINT("Receive Failed");
-      else if (error == OTA_END_ERROR) DEBUG_PRINT("End Failed");
-      DEBUG_ENDGROUP;
+      const char *reason =
+        (error == OTA_AUTH_ERROR) ? "Auth Failed" :
+        (error == OTA_BEGIN_ERROR) ? "Begin Failed" :
+        (error == OTA_CONNECT_ERROR) ? "Connect Failed" :
+        (error == OTA_RECEIVE_ERROR) ? "Receive Failed" :
+        (error == OTA_END_ERROR) ? "End Failed" : "";
+      LOG_E(OTA, "Error[%u]: %s", (unsigned)error, reason);
     });
 
-  ArduinoOTA.begin();
+  // ArduinoOTA.begin() happens on each WiFi connection; see network_on_connect()
 }
 
 #ifdef USE_REMOTEDEBUG
 static void remotedebug_setup() {
-  // Assumes MDNS already started; call after ota_setup()
-  MDNS.addService("telnet", "tcp", 23);
-
+  // Telnet MDNS service is added on each WiFi connection; see network_on_connect()
   rdbg.begin(MDNS_HOSTNAME);
   rdbg.setSerialEnabled(true);
   rdbg.setResetCmdEnabled(true);
 	//rdbg.showProfiler(true);
 	rdbg.showColors(true);
-  DEBUG_MSG("RemoteDebug ready...")
+  LOG_I(SYSTEM, "RemoteDebug ready");
 }
 #endif
 
 static void ntp_setup() {
-  ntpClient.begin();
+  // ntpClient.begin() happens on each WiFi connection; see network_on_connect()
   ntpClient.setTimeOffset(NTP_TIME_OFFSET);
 }
 
-static void mqtt_callback(const char *topic, const byte *payload, unsigned int length) {
-  // Safely copy payload bytes into a string
-  String data((const char *)NULL);  // Needs cast, otherwise treats arg as (int)0 ?!
-  data.reserve(length);  // We do not need to +1 for '\0'
-  for (int i = 0;  i < length; i++)
-    data.concat((char)(payload[i]));
-
-  DEBUG_MSG("MQTT received: topic: '%s' / payload: '%s'", topic, data.c_str());
-
-  // Process command
-  if (!strcmp(topic, MQTT_TOPIC_HEATER_CONTROL)) {
-    heaterControl = _parseControlState(data);
-    _setRelayOn(false);
-  }
-  else if (!strcmp(topic, MQTT_TOPIC_RELAY_CONTROL)) {
-    if (heaterControl == CONTROL_MANUAL) {
-      _setRelayOn(data == "on");
-    }
-    // else, just ignore command
-  }
-#ifdef HAS_WATER_REFILL
-  else if (!strcmp(topic, MQTT_TOPIC_REFILL_CONTROL)) {
-    refillControl = _parseControlState(data);
-    _setValveOn(false);
-  }
-  else if (!strcmp(topic, MQTT_TOPIC_VALVE_CONTROL)) {
-    if (refillControl == CONTROL_MANUAL) {
-      _setValveOn(data == "on");
-    }
-  }
-#endif
-  else if (!strcmp(topic, MQTT_TOPIC_MAIN_SETPOINT)) {
-    float value = (float)atof(data.c_str());
-    mainSetpointHi = value + SETPOINT_MAIN_OVERSHOOT;
-    mainSetpointLo = value - SETPOINT_MAIN_UNDERSHOOT;
-  }
-#ifdef HAS_HEAT_EXCHANGER
-  else if (!strcmp(topic, MQTT_TOPIC_EXCHANGER_SETPOINT)) {
-    float value = (float)atof(data.c_str());
-    exchangerSetpointHi = value + SETPOINT_EXCHANGER_OVERSHOOT;
-    exchangerSetpointLo = value - SETPOINT_EXCHANGER_UNDERSHOOT;
-  }
-#endif
-  else {
-    DEBUG_MSG("Unknown topic: %s", topic);
-  }
+// Current UTC time (sec), or 0 if NTP has not synced yet
+static uint32_t ntp_utc() {
+  unsigned long utc = ntpClient.getEpochTime() - NTP_TIME_OFFSET;
+  return (utc < NTP_MIN_VALID_EPOCH) ? 0 : utc;
 }
 
-static const int MQTT_CONNECT_RETRY_INTERVAL_SEC = 5;
-
-static unsigned long mqtt_last_reconnect = millis();
-static void mqtt_reconnect(bool force = false) {
-  unsigned long now = millis();
-  if (now - mqtt_last_reconnect <= MQTT_CONNECT_RETRY_INTERVAL_SEC * 1000 && !force)
-    return;
-  mqtt_last_reconnect = now;
+#ifdef USE_HISTORY
+#  ifdef HAS_WATER_REFILL
+static PoolHistory history(LEVEL_HI);
+#  else
+static PoolHistory history(0);
+#  endif
 
-  u8x8.clearLine(3);
-  u8x8.setCursor(0, 3);
-  u8x8.printf("MQTT connecting");
-  
-  // Attempt to connect
-  DEBUG_MSG("Attempting MQTT connection... ");
-  String clientId(MQTT_CLIENT_ID_PREFIX);
-  clientId += String(random(0xffff), HEX);
-  if (mqttClient.connect(clientId.c_str())) {
-    DEBUG_MSG("MQTT connected as %s", clientId.c_str());
-
-    mqttClient.subscribe(MQTT_TOPIC_HEATER_CONTROL);
-    mqttClient.subscribe(MQTT_TOPIC_RELAY_CONTROL);
-    mqttClient.subscribe(MQTT_TOPIC_MAIN_SETPOINT);
-#ifdef HAS_HEAT_EXCHANGER
-    mqttClient.subscribe(MQTT_TOPIC_EXCHANGER_SETPOINT);
+// Reply in progress, if any (see history_update())
+static struct {
+  bool active;
+  history_resolution_t resolution;
+  uint32_t from, to;
+} historyQuery;
 #endif
-#ifdef HAS_WATER_REFILL
-    mqttClient.subscribe(MQTT_TOPIC_REFILL_CONTROL);
-    mqttClient.subscribe(MQTT_TOPIC_VALVE_CONTROL);
+
+// MQTT payloads are parsed in place, without copying to the heap
+static inline bool _payloadIs(const byte *payload, unsigned int length, const char *str) {
+  return length == strlen(str) && !memcmp(payload, str, length);
+}
+
+static control_state_t _parseControlState(const byte *payload, unsigned int length) {
+  if (_payloadIs(payload, length, "on") || _payloadIs(payload, length, "auto")) {
+    return CONTROL_AUTO;
+  } else if (_payloadIs(payload, length, "manual")) {
+    return CONTROL_MANUAL;
+  }
+  return CONTROL_OFF;
+}
+
+static bool _parseFloat(const byte *payload, unsigned int length, float &value) {
+  char buf[16];
+  if (length == 0 || length >= sizeof(buf))
+    return false;
+  memcpy(buf, payload, length);
+  buf[length] = '\0';
+  char *end;
+  value = strtof(buf, &end);
+  return end == buf + length;
+}
+
+// Command handlers; commands are carried out on the control side (see
+// command_update())
+template <command_type_t TYPE>
+static void _onControlState(const byte *payload, unsigned int length) {
+  command_t cmd;
+  cmd.type = TYPE;
+  cmd.state = _parseControlState(payload, length);
+  _postCommand(cmd);
+}
+
+template <command_type_t TYPE>
+static void _onSwitch(const byte *payload, unsigned int length) {
+  command_t cmd;
+  cmd.type = TYPE;
+  cmd.on = _payloadIs(payload, length, "on");
+  _postCommand(cmd);
+}
+
+template <command_type_t TYPE>
+static void _onSetpoint(const byte *payload, unsigned int length) {
+  command_t cmd;
+  cmd.type = TYPE;
+  if (!_parseFloat(payload, length, cmd.value)) {
+    LOG_W(MQTT, "Invalid setpoint: '%.*s'", (int)length, (const char *)payload);
+    return;
+  }
+  _postCommand(cmd);
+}
+
+#ifdef USE_HISTORY
+// Not a command; history lives on the network side, so this just starts
+// a reply (replacing any in progress), which history_update() sends
+static void _onHistoryQuery(const byte *payload, unsigned int length) {
+  char buf[32];
+  if (length >= sizeof(buf)) {
+    LOG_W(MQTT, "Invalid history query: '%.*s'", (int)length, (const char *)payload);
+    return;
+  }
+  memcpy(buf, payload, length);
+  buf[length] = '\0';
+  char code;
+  unsigned long from, to = UINT32_MAX;
+  const char *res;
+  if (sscanf(buf, " %c %lu %lu", &code, &from, &to) < 2 || !(res = (const char *)memchr(HISTORY_RESOLUTION_CODES, code, NUM_HISTORY_RESOLUTIONS))) {
+    LOG_W(MQTT, "Invalid history query: '%s'", buf);
+    return;
+  }
+  historyQuery.resolution = (history_resolution_t)(res - HISTORY_RESOLUTION_CODES);
+  historyQuery.from = from;
+  historyQuery.to = to;
+  historyQuery.active = true;
+}
+#endif
+
+// Subscribed topics; a topic is matched with one hash and one strcmp
+typedef void (*mqtt_handler_t)(const byte *payload, unsigned int length);
+
+typedef struct {
+  uint32_t hash;
+  const char *topic;
+  mqtt_handler_t handler;
+} mqtt_route_t;
+
+#define MQTT_ROUTE(topic, handler)  { topic_hash(topic), topic, handler }
+
+static constexpr mqtt_route_t MQTT_ROUTES[] = {
+  MQTT_ROUTE(MQTT_TOPIC_HEATER_CONTROL, _onControlState<CMD_HEATER_CONTROL>),
+  MQTT_ROUTE(MQTT_TOPIC_RELAY_CONTROL, _onSwitch<CMD_RELAY>),
+  MQTT_ROUTE(MQTT_TOPIC_MAIN_SETPOINT, _onSetpoint<CMD_MAIN_SETPOINT>),
+#ifdef HAS_HEAT_EXCHANGER
+  MQTT_ROUTE(MQTT_TOPIC_EXCHANGER_SETPOINT, _onSetpoint<CMD_EXCHANGER_SETPOINT>),
+#endif
+#ifdef HAS_WATER_REFILL
+  MQTT_ROUTE(MQTT_TOPIC_REFILL_CONTROL, _onControlState<CMD_REFILL_CONTROL>),
+  MQTT_ROUTE(MQTT_TOPIC_VALVE_CONTROL, _onSwitch<CMD_VALVE>),
+#endif
+#ifdef USE_HISTORY
+  MQTT_ROUTE(MQTT_TOPIC_HISTORY_QUERY, _onHistoryQuery),
+#endif
+};
+static constexpr size_t MQTT_ROUTES_COUNT = sizeof(MQTT_ROUTES) / sizeof(MQTT_ROUTES[0]);
+
+static constexpr bool _mqttRoutesUnique(size_t i = 0, size_t j = 1) {
+  return (i >= MQTT_ROUTES_COUNT) ? true
+    : (j >= MQTT_ROUTES_COUNT) ? _mqttRoutesUnique(i + 1, i + 2)
+    : (MQTT_ROUTES[i].hash != MQTT_ROUTES[j].hash) && _mqttRoutesUnique(i, j + 1);
+}
+static_assert(_mqttRoutesUnique(), "MQTT topic hash collision; rename a topic");
+
+static void mqtt_callback(const char *topic, const byte *payload, unsigned int length) {
+  MEM_SITE(memSites[MEM_SITE_MQTT_CALLBACK]);
+  LOG_D(MQTT, "Received: topic: '%s' / payload: '%.*s'", topic, (int)length, (const char *)payload);
+#ifdef USE_TRACE
+  trace.command(millis(), topic, payload, length);
 #endif
 
-    u8x8.clearLine(3);
-    u8x8.setCursor(1, 3);
-    u8x8.printf("MQTT connected");
+  uint32_t hash = topic_hash(topic);
+  for (const mqtt_route_t &route : MQTT_ROUTES) {
+    if (route.hash == hash) {
+      if (!strcmp(topic, route.topic)) {
+        route.handler(payload, length);
+        return;
+      }
+      break;  // Hashes are unique
+    }
+  }
+  LOG_W(MQTT, "Unknown topic: %s", topic);
+}
+
+// PubSubClient::connect() blocks until CONNACK (or timeout), so keep
+// the socket timeout short, and back off between failed attempts; this
+// only ever stalls the network task
+static const uint32_t MQTT_BACKOFF_MIN_MS = 1000;
+static const uint32_t MQTT_BACKOFF_MAX_MS = 60000;
+static const uint16_t MQTT_SOCKET_TIMEOUT_SEC = 2;
+
+static Backoff mqttBackoff(MQTT_BACKOFF_MIN_MS, MQTT_BACKOFF_MAX_MS);
+static job_id_t mqttReconnectJob;  // One-shot; started by network_poll() and network_on_connect()
+
+static void mqtt_reconnect() {
+  TIME_SCOPE(networkTiming, TIMER_MQTT_CONNECT);
+  MEM_SITE(memSites[MEM_SITE_MQTT_CONNECT]);
+  if (!wifi_connected() || mqttClient.connected())
+    return;
+
+  screen.printCentered(3, "MQTT connecting");
+  
+  // Attempt to connect
+  LOG_I(MQTT, "Connecting");
+  char clientId[32];
+  snprintf(clientId, sizeof(clientId), "%s%lx", MQTT_CLIENT_ID_PREFIX, (unsigned long)random(0xffff));
+  if (mqttClient.connect(clientId)) {
+    LOG_I(MQTT, "Connected as %s", clientId);
+
+    for (const mqtt_route_t &route : MQTT_ROUTES)
+      mqttClient.subscribe(route.topic);
+
+    screen.printCentered(3, "MQTT connected");
+    mqttBackoff.reset();
   } else {
-    DEBUG_MSG("MQTT connect failed, rc=%d", mqttClient.state());
+    uint32_t wait = mqttBackoff.fail();
+    networkScheduler.start(mqttReconnectJob, wait);
+    LOG_W(MQTT, "Connect failed, rc=%d, retry in %u ms", mqttClient.state(), (unsigned)wait);
 
-    u8x8.clearLine(3);
-    u8x8.setCursor(3, 3);
-    u8x8.printf("MQTT failed");
+    screen.printCentered(3, "MQTT failed");
   }
 }
 
@@ -464,51 +1192,231 @@ static void mqtt_setup() {
   randomSeed(micros());
   mqttClient.setServer(MQTT_SERVER, MQTT_PORT);
   mqttClient.setCallback(mqtt_callback);
+  mqttClient.setSocketTimeout(MQTT_SOCKET_TIMEOUT_SEC);
+  mqttReconnectJob = networkScheduler.add(mqtt_reconnect);
+#ifdef USE_OUTBOX_SPILL
+  if (SPIFFS.begin(true)) {
+    mqttOutbox.spillTo(SPIFFS, MQTT_OUTBOX_SPILL_PATH, MQTT_OUTBOX_SPILL_MAX_BYTES);
+  } else {
+    LOG_E(MQTT, "SPIFFS mount failed, outbox will not spill");
+  }
+#endif
+  // Connection happens once WiFi is up; see network_on_connect()
+}
 
-  mqtt_reconnect(true);
+static ReportPolicy mainTempReport(TEMP_REPORT_DEADBAND, TEMP_REPORT_MIN_INTERVAL_MS, TEMP_REPORT_MAX_INTERVAL_MS);
+#ifdef HAS_HEAT_EXCHANGER
+static ReportPolicy exchangerTempReport(TEMP_REPORT_DEADBAND, TEMP_REPORT_MIN_INTERVAL_MS, TEMP_REPORT_MAX_INTERVAL_MS);
+#endif
+#ifdef HAS_WATER_REFILL
+static ReportPolicy waterLevelReport(0, 0, LEVEL_REPORT_MAX_INTERVAL_MS);
+static const char* const WATER_LEVEL_NAMES[] = { "lo", "mid", "hi", "invalid" };  // By level_t
+#endif
+
+#ifndef USE_TELEMETRY_FRAME
+// Readings carry a timestamp, in case they are held back (see MQTTOutbox.h)
+static void _publishTemperature(const char *topic, float value, uint32_t utc) {
+  char payload[16];
+  snprintf(payload, sizeof(payload), "%.2f", value);
+  mqttOutbox.publish(topic, payload, utc);
+  LOG_D(MQTT, "Published %s %sF", topic, payload);
 }
+#endif
 
-static unsigned long mqtt_last_update = millis();
-static void mqtt_update_values() {
-  //if (!mqttClient.connected())
-  //  return;
+#ifdef USE_TELEMETRY_FRAME
+static ReportPolicy relayReport(0, 0, TEMP_REPORT_MAX_INTERVAL_MS);
+#  ifdef HAS_WATER_REFILL
+static ReportPolicy valveReport(0, 0, TEMP_REPORT_MAX_INTERVAL_MS);
+#  endif
+
+// If any channel is due, queue a record with all of them
+static void _queueTelemetry(unsigned long now, uint32_t utc) {
+  bool due = mainTempReport.due(controlStatus.mainTemperature, now) || relayReport.due(controlStatus.relayOn, now);
+#  ifdef HAS_HEAT_EXCHANGER
+  due = due || exchangerTempReport.due(controlStatus.exchangerTemperature, now);
+#  endif
+#  ifdef HAS_WATER_REFILL
+  due = due || waterLevelReport.due(controlStatus.waterLevel, now) || valveReport.due(controlStatus.valveOn, now);
+#  endif
+  if (!due)
+    return;
+
+  telemetry_record_t rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.utc = utc;
+  rec.mainTemperature = controlStatus.mainTemperature;
+  mainTempReport.reported(rec.mainTemperature, now);
+  rec.relayOn = controlStatus.relayOn;
+  relayReport.reported(rec.relayOn, now);
+#  ifdef HAS_HEAT_EXCHANGER
+  rec.exchangerTemperature = controlStatus.exchangerTemperature;
+  exchangerTempReport.reported(rec.exchangerTemperature, now);
+#  endif
+#  ifdef HAS_WATER_REFILL
+  rec.waterLevel = controlStatus.waterLevel;
+  waterLevelReport.reported(rec.waterLevel, now);
+  rec.valveOn = controlStatus.valveOn;
+  valveReport.reported(rec.valveOn, now);
+#  endif
+  telemetry.push(rec);
+}
 
-  // Periodically post current temperature values
+// Send queued records, as frames, while the broker accepts them
+static void telemetry_flush() {
+  uint8_t frame[Telemetry::MAX_FRAME_SIZE];
+  uint8_t nRecords;
+  size_t size;
+  while (mqttClient.connected() && (size = telemetry.encode(frame, nRecords)) > 0) {
+    if (!mqttClient.publish(MQTT_TOPIC_TELEMETRY, frame, size))
+      break;
+    telemetry.consume(nRecords);
+  }
+}
+#endif
+
+// Publish whichever readings are due, per their ReportPolicy
+static void mqtt_update_values() {
+  TIME_SCOPE(networkTiming, TIMER_MQTT_VALUES);
+  if (!controlStatus.hasReadings)
+    return;
   unsigned long now = millis();
-  if (now - mqtt_last_update < MQTT_UPDATE_INTERVAL_SEC * 1000)
+  uint32_t utc = ntp_utc();
+
+#ifdef USE_TELEMETRY_FRAME
+  _queueTelemetry(now, utc);
+  telemetry_flush();
+#else
+  if (mainTempReport.update(controlStatus.mainTemperature, now))
+    _publishTemperature(MQTT_TOPIC_MAIN_TEMP, controlStatus.mainTemperature, utc);
+#  ifdef HAS_HEAT_EXCHANGER
+  if (exchangerTempReport.update(controlStatus.exchangerTemperature, now))
+    _publishTemperature(MQTT_TOPIC_EXCHANGER_TEMP, controlStatus.exchangerTemperature, utc);
+#  endif
+
+#  ifdef HAS_WATER_REFILL
+  if (waterLevelReport.update(controlStatus.waterLevel, now)) {
+    mqttOutbox.publish(MQTT_TOPIC_WATER_LEVEL, WATER_LEVEL_NAMES[controlStatus.waterLevel], utc);
+    LOG_D(MQTT, "Published water level %s", WATER_LEVEL_NAMES[controlStatus.waterLevel]);
+  }
+#  endif
+#endif  // USE_TELEMETRY_FRAME
+}
+
+#ifdef USE_HISTORY
+// Every snapshot is a sample, so relay and valve duty cycles follow their
+// transitions; none until NTP has synced, since buckets go by UTC
+static void _addHistory(const status_t &s) {
+  uint32_t utc = ntp_utc();
+  if (!s.hasReadings || !utc)
     return;
-  mqtt_last_update = now;
+  history_sample_t h;
+  h.utc = utc;
+  h.mainTemperature = s.mainTemperature;
+  h.relayOn = s.relayOn;
+#  ifdef HAS_HEAT_EXCHANGER
+  h.exchangerTemperature = s.exchangerTemperature;
+#  else
+  h.exchangerTemperature = NAN;
+#  endif
+#  ifdef HAS_WATER_REFILL
+  h.waterLevel = s.waterLevel;
+  h.valveOn = s.valveOn;
+#  else
+  h.waterLevel = HISTORY_LEVEL_NONE;
+  h.valveOn = false;
+#  endif
+  history.add(h, millis());
+}
 
-  mqttClient.publish(MQTT_TOPIC_MAIN_TEMP, String(mainTemperature, 2).c_str());
-  DEBUG_MSG("Published temperature %5.2fF", mainTemperature);
-#ifdef HAS_HEAT_EXCHANGER
-  mqttClient.publish(MQTT_TOPIC_EXCHANGER_TEMP, String(exchangerTemperature, 2).c_str());
-  DEBUG_MSG("Published exchanger temperature %5.2fF", exchangerTemperature);
+// Send the next frames of the reply in progress; if the broker does not
+// take one, it is sent again on the next pass
+static void history_update() {
+  uint8_t frame[PoolHistory::MAX_FRAME_SIZE];
+  for (uint8_t i = 0;  historyQuery.active && i < HISTORY_FRAMES_PER_POLL;  i++) {
+    uint32_t from = historyQuery.from;
+    size_t size = history.encode(historyQuery.resolution, from, historyQuery.to, frame);
+    if (!mqttClient.connected() || !mqttClient.publish(MQTT_TOPIC_HISTORY_DATA, frame, size))
+      return;
+    historyQuery.from = from;
+    historyQuery.active = !(frame[3] & HISTORY_FLAG_LAST);
+  }
+}
 #endif
 
+// Publish control state transitions right away, keep latest snapshot for
+// display_update(), and publish readings from it, as they change
+static void status_update() {
+  MEM_SITE(memSites[MEM_SITE_STATUS]);
+  bool updated = false;
+  status_t s;
+  while (statusQueue.pop(s)) {
+    controlStatus = s;
+    updated = true;
+#ifdef USE_HISTORY
+    _addHistory(s);
+#endif
+    if (s.event == STATUS_RELAY) {
+      mqttOutbox.publish(MQTT_TOPIC_RELAY_STATE, s.relayOn ? "on" : "off", ntp_utc());
+    }
 #ifdef HAS_WATER_REFILL
-  switch (waterLevel) {
-    case LEVEL_LO:
-      mqttClient.publish(MQTT_TOPIC_WATER_LEVEL, "lo");
-      break;
-    case LEVEL_MID:
-      mqttClient.publish(MQTT_TOPIC_WATER_LEVEL, "mid");
-      break;
-    case LEVEL_HI:
-      mqttClient.publish(MQTT_TOPIC_WATER_LEVEL, "hi");
-      break;
-    case LEVEL_INVALID:
-      mqttClient.publish(MQTT_TOPIC_WATER_LEVEL, "invalid");
-      break;
+    else if (s.event == STATUS_VALVE) {
+      mqttOutbox.publish(MQTT_TOPIC_VALVE_STATE, s.valveOn ? "on" : "off", ntp_utc());
+    }
+#endif
   }
-  DEBUG_MSG("Published water level %d", (int)waterLevel);
+  if (updated)
+    mqtt_update_values();
+}
+
+static job_id_t thermostatSampleJob;  // Periodic, while measuring
+static job_id_t relayLockoutJob;  // Timer only; limits relay cycling in auto mode
+
+// Periodic job; start new measurements, which thermostat_update() then
+// samples until they are complete
+static void thermostat_request() {
+  mainTemperatureSensor.request();
+#ifdef HAS_HEAT_EXCHANGER
+  exchangerTemperatureSensor.request();
 #endif
+  if (!controlScheduler.pending(thermostatSampleJob))
+    controlScheduler.start(thermostatSampleJob);
+}
+
+static void thermostat_update();
+
+#if defined(USE_ADS1115_CONTINUOUS) || defined(USE_I2S_ADC)
+// Periodic job; keeps converters drained, whether measuring or not
+static void adc_collect() {
+  TIME_SCOPE(controlTiming, TIMER_ADC);
+#  if defined(USE_ADS1115_CONTINUOUS)
+  ads1115.update();  // Collect finished conversion (if any) into its channel buffer
+#  else
+  i2sAdc.update();  // Decimate whatever DMA has collected so far
+#  endif
 }
+#endif
 
 static void thermostat_setup() {
-#ifdef USE_ADS1115
+#if defined(USE_ADS1115_CONTINUOUS)
+  Wire.begin();
+  ads1115.addChannel(MAIN_THERMISTOR_CHANNEL);
+#  ifdef HAS_HEAT_EXCHANGER
+  ads1115.addChannel(EXCHANGER_THERMISTOR_CHANNEL);
+#  endif
+  if (!ads1115.begin(ADS1115_PGA, ADS1115_DATA_RATE, ADS1115_ALERT_PIN)) {
+    LOG_E(THERMOSTAT, "ADS1115 not responding");
+  }
+#elif defined(USE_ADS1115)
   ads1115.begin();
-  ads1115.setGain(GAIN_ONE);
+  ads1115.setGain((adsGain_t)(ADS1115_PGA << 9));  // Same encoding as the PGA register field
+#elif defined(USE_I2S_ADC)
+  i2sAdc.addPin(MAIN_THERMISTOR_PIN);
+#  ifdef HAS_HEAT_EXCHANGER
+  i2sAdc.addPin(EXCHANGER_THERMISTOR_PIN);
+#  endif
+  if (!i2sAdc.begin(I2S_ADC_ATTENUATION)) {
+    LOG_E(THERMOSTAT, "I2S-ADC setup failed");
+  }
 #else
   analogReadResolution(ADC_RESOLUTION_BITS);
   analogSetAttenuation(ADC_ATTENUATION);  // For all pins
@@ -520,102 +1428,575 @@ static void thermostat_setup() {
 #endif
 #endif
 
+#ifdef USE_ADC_FILTER
+  _mainThermistorPort.setFilter(&_mainThermistorFilter);
+#  ifdef HAS_HEAT_EXCHANGER
+  _exchangerThermistorPort.setFilter(&_exchangerThermistorFilter);
+#  endif
+#endif
+  adcSampler.add(_mainThermistorPort);
+#ifdef HAS_HEAT_EXCHANGER
+  adcSampler.add(_exchangerThermistorPort);
+#endif
+
   pinMode(RELAY_PIN, OUTPUT);
-  _setRelayOn(false, mqttClient.connected());  // Better safe..
+  _setRelayOn(false);  // Better safe..
 
-  DEBUG_MSG("Thermostat relay and sensors ready");
+  controlScheduler.every(THERMOSTAT_UPDATE_INTERVAL_SEC * 1000, thermostat_request, THERMOSTAT_UPDATE_INTERVAL_SEC * 1000);
+  thermostatSampleJob = controlScheduler.add(thermostat_update, ADC_SAMPLE_INTERVAL_MS);
+#if defined(USE_ADS1115_CONTINUOUS) || defined(USE_I2S_ADC)
+  controlScheduler.every(ADC_COLLECT_INTERVAL_MS, adc_collect);
+#endif
+  relayLockoutJob = controlScheduler.add(NULL);
+  controlScheduler.start(relayLockoutJob, RELAY_TOGGLE_THRESHOLD_SEC * 1000);
+
+  LOG_I(THERMOSTAT, "Relay and sensors ready");
 }
 
 #ifdef HAS_WATER_REFILL
+static job_id_t valveLockoutJob;  // Limits valve cycling in auto mode; re-runs refill_update()
+static job_id_t levelSettleJob;  // One-shot, once a new level may have held long enough
+
+// Edges from both level switches, timestamped; there is a single
+// producer, as GPIO interrupts are all dispatched from one handler
+typedef struct {
+  uint32_t ms;
+  uint8_t pin;
+  uint8_t level;
+} level_edge_t;
+
+static SPSCQueue<level_edge_t, 16> levelEdgeQueue;
+static volatile bool levelEdgesLost = false;  // Queue was full; re-read pins
+
+static int levelPins[2];  // Last known (raw) HI and MID pin levels
+static Debouncer<level_t> waterLevelDebouncer(LEVEL_LO);
+
+static void refill_update();
+
+static void IRAM_ATTR _onLevelEdge(void *arg) {
+  uint8_t pin = (uint8_t)(uintptr_t)arg;
+  level_edge_t e = { (uint32_t)millis(), pin, (uint8_t)digitalRead(pin) };
+  if (!levelEdgeQueue.push(e))
+    levelEdgesLost = true;
+#ifdef USE_RTOS_TASKS
+  BaseType_t woken = pdFALSE;
+  if (controlTask)
+    vTaskNotifyGiveFromISR(controlTask, &woken);  // As _postCommand()
+  if (woken)
+    portYIELD_FROM_ISR();
+#endif
+}
+
+// Water presence shorts the pullup pin to ground
+static level_t _waterLevel(int hiLevel, int midLevel) {
+  bool hiClosed = !hiLevel;
+  bool midClosed = !midLevel;
+  if (hiClosed && !midClosed)
+    return LEVEL_INVALID;
+  else if (hiClosed)
+    return LEVEL_HI;
+  else if (midClosed)
+    return LEVEL_MID;
+  return LEVEL_LO;
+}
+
+static inline uint32_t _levelSettleMs(level_t level) {
+  return (level == LEVEL_INVALID) ? LEVEL_INVALID_SETTLE_MS : LEVEL_SETTLE_MS;
+}
+
+// Raw pin level at time ms; (re)arms levelSettleJob for a new level
+static void _levelInput(uint8_t pin, int level, unsigned long ms) {
+#ifdef USE_TRACE
+  _tracePin(pin, level);
+#endif
+  levelPins[pin == WATERLEVEL_MID_PIN] = level;
+  waterLevelDebouncer.input(_waterLevel(levelPins[0], levelPins[1]), ms);
+  if (waterLevelDebouncer.pending()) {
+    unsigned long now = millis();
+    uint32_t held = now - waterLevelDebouncer.since();
+    uint32_t hold = _levelSettleMs(waterLevelDebouncer.candidate());
+    controlScheduler.start(levelSettleJob, (held < hold) ? hold - held : 0, now);
+  } else {
+    controlScheduler.stop(levelSettleJob);  // Back to the settled level
+  }
+}
+
+static void _levelResync() {
+  unsigned long now = millis();
+  _levelInput(WATERLEVEL_HI_PIN, digitalRead(WATERLEVEL_HI_PIN), now);
+  _levelInput(WATERLEVEL_MID_PIN, digitalRead(WATERLEVEL_MID_PIN), now);
+}
+
+// On every control pass; cheap unless there are new edges
+static void level_update() {
+  level_edge_t e;
+  while (levelEdgeQueue.pop(e))
+    _levelInput(e.pin, e.level, e.ms);
+  if (levelEdgesLost) {
+    levelEdgesLost = false;
+    _levelResync();
+  }
+}
+
+// One-shot job
+static void _levelSettle() {
+  if (!waterLevelDebouncer.settle(millis(), _levelSettleMs(waterLevelDebouncer.candidate())))
+    return;
+  waterLevel = waterLevelDebouncer.stable();
+  LOG_I(REFILL, "Water level %s", WATER_LEVEL_NAMES[waterLevel]);
+  _postStatus(STATUS_READINGS);  // Published right away; see waterLevelReport
+  refill_update();
+}
+
 static void refill_setup() {
   // Solenoid valve switch
   pinMode(VALVE_PIN, OUTPUT);
-  _setValveOn(false, mqttClient.connected());  // Better safe...
+  _setValveOn(false);  // Better safe...
 
-  // Water level sensor pins
+  // Water level sensor pins; the level at boot counts right away
   pinMode(WATERLEVEL_HI_PIN, INPUT_PULLUP);
   pinMode(WATERLEVEL_MID_PIN, INPUT_PULLUP);
+  levelPins[0] = digitalRead(WATERLEVEL_HI_PIN);
+  levelPins[1] = digitalRead(WATERLEVEL_MID_PIN);
+#ifdef USE_TRACE
+  _tracePin(WATERLEVEL_HI_PIN, levelPins[0]);
+  _tracePin(WATERLEVEL_MID_PIN, levelPins[1]);
+#endif
+  waterLevel = _waterLevel(levelPins[0], levelPins[1]);
+  waterLevelDebouncer.reset(waterLevel);
+  attachInterruptArg(digitalPinToInterrupt(WATERLEVEL_HI_PIN), _onLevelEdge, (void *)(uintptr_t)WATERLEVEL_HI_PIN, CHANGE);
+  attachInterruptArg(digitalPinToInterrupt(WATERLEVEL_MID_PIN), _onLevelEdge, (void *)(uintptr_t)WATERLEVEL_MID_PIN, CHANGE);
 
-  DEBUG_MSG("Refill valve and sensors ready")
+  levelSettleJob = controlScheduler.add(_levelSettle);
+  controlScheduler.every(LEVEL_RESYNC_INTERVAL_MS, _levelResync, LEVEL_RESYNC_INTERVAL_MS);
+  valveLockoutJob = controlScheduler.add(refill_update);  // Re-checks once lockout is over
+  controlScheduler.start(valveLockoutJob, VALVE_TOGGLE_THRESHOLD_SEC * 1000);
+
+  LOG_I(REFILL, "Valve and sensors ready");
 }
 
-static unsigned long valve_last_toggle = millis();
+// Valve control, in auto mode; runs on every settled level change, at
+// the end of each lockout, and when switched to auto
 static void refill_update() {
-  // Update water level; water presence will short pullup pin to ground
-  bool hiClosed = !digitalRead(WATERLEVEL_HI_PIN);
-  bool midClosed = !digitalRead(WATERLEVEL_MID_PIN);
-  if (hiClosed && !midClosed)
-    waterLevel = LEVEL_INVALID;
-  else if (hiClosed)
-    waterLevel = LEVEL_HI;
-  else if (midClosed)
-    waterLevel = LEVEL_MID;
-  else
-    waterLevel = LEVEL_LO;
+  TIME_SCOPE(controlTiming, TIMER_REFILL);
+  REPORT_COST(refill);
 
   if (refillControl != CONTROL_AUTO)
     return;
 
   // Limit valve cycling frequency
-  unsigned long now = millis();
-  if (now - valve_last_toggle < VALVE_TOGGLE_THRESHOLD_SEC * 1000)
+  if (controlScheduler.pending(valveLockoutJob))
     return;
 
   bool valveOpen = _getValveOn();
   if (valveOpen && waterLevel == LEVEL_HI) {
     _setValveOn(false);
-    valve_last_toggle = now;
+    controlScheduler.start(valveLockoutJob, VALVE_TOGGLE_THRESHOLD_SEC * 1000);
   } else if (!valveOpen && waterLevel != LEVEL_HI) {
     _setValveOn(true);
-    valve_last_toggle = now;
+    controlScheduler.start(valveLockoutJob, VALVE_TOGGLE_THRESHOLD_SEC * 1000);
   }
 }
 #endif
 
-static unsigned long thermostat_last_update = millis();
-static unsigned long relay_last_toggle = millis();
+// Periodic job, while a measurement is in progress.  Takes (at most)
+// one ADC sample per run; averaging happens incrementally, interleaved
+// across all sensors.
 static void thermostat_update() {
-  // Limit update frequency, since readings take some time, due to averaging
+  TIME_SCOPE(controlTiming, TIMER_THERMOSTAT);
+  REPORT_COST(thermostat);
   unsigned long now = millis();
-  if (now - thermostat_last_update < THERMOSTAT_UPDATE_INTERVAL_SEC * 1000)
-    return;
-  thermostat_last_update = now;
 
-  // Update temperature values
-  mainTemperature = mainTemperatureSensor.fahrenheit();
-#if HAS_HEAT_EXCHANGER
-  exchangerTemperature = exchangerTemperatureSensor.fahrenheit();
+  {
+    TIME_SCOPE(controlTiming, TIMER_ADC);
+    adcSampler.update(now);  // Converters are drained by adc_collect()
+  }
+  if (!adcSampler.busy())
+    controlScheduler.stop(thermostatSampleJob);  // Until next thermostat_request()
+
+  // Update temperature values, as they become available
+  bool updated = false;
+  if (mainTemperatureSensor.available()) {
+    mainTemperature = (float)mainTemperatureSensor.fahrenheit();
+    updated = true;
+  }
+#ifdef HAS_HEAT_EXCHANGER
+  if (exchangerTemperatureSensor.available()) {
+    exchangerTemperature = (float)exchangerTemperatureSensor.fahrenheit();
+    updated = true;
+  }
 #endif
+  if (!updated)
+    return;
+  LOG_D(THERMOSTAT, "Main %.2f'F", mainTemperature);
+  hasReadings = true;
+  _postStatus(STATUS_READINGS);
 
   if (heaterControl != CONTROL_AUTO) 
     return;
+  _reportReading();
 
   // Limit heater relay cycle frequency
-  if (now - relay_last_toggle < RELAY_TOGGLE_THRESHOLD_SEC * 1000)
+  if (controlScheduler.pending(relayLockoutJob))
     return;
 
   // Update heater relay state
   if (_getRelayOn()) {
     bool turnOff = (mainTemperature > mainSetpointHi);
-#if HAS_HEAT_EXCHANGER
+#ifdef HAS_HEAT_EXCHANGER
     turnOff = turnOff || (exchangerTemperature > exchangerSetpointHi);
 #endif
     if (turnOff) {
       _setRelayOn(false);
-      relay_last_toggle = now;
+      controlScheduler.start(relayLockoutJob, RELAY_TOGGLE_THRESHOLD_SEC * 1000, now);
     }
   } else {
     bool turnOn = (mainTemperature < mainSetpointLo);
-#if HAS_HEAT_EXCHANGER
+#ifdef HAS_HEAT_EXCHANGER
     turnOn = turnOn && (exchangerTemperature < exchangerSetpointLo);
 #endif
     if (turnOn) {
       _setRelayOn(true);
-      relay_last_toggle = now;
+      controlScheduler.start(relayLockoutJob, RELAY_TOGGLE_THRESHOLD_SEC * 1000, now);
+    }
+  }
+}
+
+// Carry out commands received by mqtt_callback(); on every control pass
+static void command_update() {
+  TIME_SCOPE(controlTiming, TIMER_COMMAND);
+  REPORT_COST(command);
+  command_t cmd;
+  while (commandQueue.pop(cmd)) {
+#ifdef USE_LOOP_TIMING
+    controlTiming[TIMER_COMMAND_LATENCY].record(micros() - cmd.posted);
+#endif
+    switch (cmd.type) {
+      case CMD_HEATER_CONTROL:
+        heaterControl = cmd.state;
+        _setRelayOn(false);
+        break;
+      case CMD_RELAY:
+        if (heaterControl == CONTROL_MANUAL) {
+          _setRelayOn(cmd.on);
+        }
+        // else, just ignore command
+        break;
+      case CMD_MAIN_SETPOINT:
+        mainSetpointHi = cmd.value + SETPOINT_MAIN_OVERSHOOT;
+        mainSetpointLo = cmd.value - SETPOINT_MAIN_UNDERSHOOT;
+        _postStatus(STATUS_READINGS);
+        break;
+#ifdef HAS_HEAT_EXCHANGER
+      case CMD_EXCHANGER_SETPOINT:
+        exchangerSetpointHi = cmd.value + SETPOINT_EXCHANGER_OVERSHOOT;
+        exchangerSetpointLo = cmd.value - SETPOINT_EXCHANGER_UNDERSHOOT;
+        break;
+#endif
+#ifdef HAS_WATER_REFILL
+      case CMD_REFILL_CONTROL:
+        refillControl = cmd.state;
+        _setValveOn(false);
+        refill_update();  // Does nothing unless auto
+        break;
+      case CMD_VALVE:
+        if (refillControl == CONTROL_MANUAL) {
+          _setValveOn(cmd.on);
+        }
+        break;
+#endif
     }
   }
 }
 
+/***************************************************************************
+ *
+ ***************************************************************************/
+
+// Sensing and actuation; owns all control state.  Carries out pending
+// commands and runs whatever control jobs are due, and returns msec until
+// the next one.
+static uint32_t control_update() {
+  TIME_SCOPE(controlTiming, TIMER_CONTROL_PASS);
+#ifdef USE_LOOP_TIMING
+  controlTiming.poll();
+#endif
+  command_update();
+#ifdef HAS_WATER_REFILL
+  level_update();
+#endif
+  return controlScheduler.run();
+}
+
+// Called on every (re)connection to WiFi; sockets and the MDNS responder
+// do not survive a disconnect, so restart everything that uses them
+static void network_on_connect() {
+  ntpClient.end();
+  ntpClient.begin();
+  ArduinoOTA.end();
+  ArduinoOTA.begin();  // Also (re)starts MDNS
+#ifdef USE_REMOTEDEBUG
+  MDNS.addService("telnet", "tcp", 23);
+#endif
+  mqttBackoff.reset();
+  networkScheduler.start(mqttReconnectJob);  // Right away, on this scheduler pass
+}
+
+#ifdef USE_LOOP_TIMING
+template <uint8_t N>
+static void _publishTiming(const char* task, const char* const names[], const TimingGroup<N>& group) {
+  char topic[64], payload[96];
+  float periodSec = group.periodUs() / 1e6;
+  for (uint8_t i = 0;  i < N;  i++) {
+    const timing_summary_t& t = group.summary(i);
+    snprintf(topic, sizeof(topic), "%s/%s/%s", MQTT_TOPIC_DIAG_TIMING, task, names[i]);
+    snprintf(payload, sizeof(payload), "{\"n\":%u,\"hz\":%.1f,\"p50\":%u,\"p99\":%u,\"max\":%u}",
+      (unsigned)t.count, (periodSec > 0) ? t.count / periodSec : 0.0f,
+      (unsigned)t.p50, (unsigned)t.p99, (unsigned)t.max);
+    mqttClient.publish(topic, payload);  // Best effort; not worth outbox space
+  }
+}
+
+// Periodic job; collect timing summaries from both tasks...
+static void diag_request() {
+  controlTiming.request();
+  networkTiming.request();
+}
+
+// ...and publish them, once ready (from network_poll())
+static void diag_update() {
+  if (controlTiming.ready()) {
+    if (mqttClient.connected())
+      _publishTiming("control", CONTROL_TIMER_NAMES, controlTiming);
+    controlTiming.release();
+  }
+  if (networkTiming.ready()) {
+    if (mqttClient.connected())
+      _publishTiming("network", NETWORK_TIMER_NAMES, networkTiming);
+    networkTiming.release();
+  }
+}
+#endif
+
+#ifdef USE_MEMORY_STATS
+static MemAlarm memoryAlarm(MEMORY_ALARM_LARGEST_BLOCK, MEMORY_ALARM_FREE_HEAP);
+
+#  ifdef USE_MEMORY_SITES
+static void _publishMemorySites() {
+  char payload[160];
+  int n = 0;
+  for (uint8_t i = 0;  i < NUM_MEM_SITES && n < (int)sizeof(payload);  i++)
+    n += snprintf(payload + n, sizeof(payload) - n, "%c\"%s\":%u", i ? ',' : '{', MEM_SITE_NAMES[i], (unsigned)memSites[i]);
+  if (n < (int)sizeof(payload) - 1) {
+    strcat(payload, "}");
+    mqttClient.publish(MQTT_TOPIC_DIAG_MEMORY_SITES, payload);
+  }
+}
+#  endif
+
+// Periodic job; check for low memory, and publish heap and stack usage
+// every MEMORY_PUBLISH_INTERVAL_SEC.  Stack figures are the least free
+// (in bytes) each task has had.
+static void memory_update() {
+  static uint8_t checks = 0;
+  mem_stats_t s;
+  memReadStats(s);
+  if (memoryAlarm.update(s)) {
+    if (memoryAlarm.on())
+      LOG_W(SYSTEM, "Low memory: %u free, largest block %u", (unsigned)s.freeHeap, (unsigned)s.largestBlock);
+    else
+      LOG_I(SYSTEM, "Memory recovered: %u free, largest block %u", (unsigned)s.freeHeap, (unsigned)s.largestBlock);
+    mqttOutbox.publish(MQTT_TOPIC_DIAG_MEMORY_ALARM, memoryAlarm.on() ? "on" : "off", ntp_utc());
+  }
+
+  if (++checks < MEMORY_PUBLISH_INTERVAL_SEC / MEMORY_CHECK_INTERVAL_SEC)
+    return;
+  checks = 0;
+  if (!mqttClient.connected())
+    return;
+  char payload[192];
+  int n = snprintf(payload, sizeof(payload), "{\"free\":%u,\"largest\":%u,\"min_free\":%u,\"frag\":%.2f",
+    (unsigned)s.freeHeap, (unsigned)s.largestBlock, (unsigned)s.minFreeHeap, memFragmentation(s));
+#  if defined(USE_RTOS_TASKS)
+  n += snprintf(payload + n, sizeof(payload) - n, ",\"stack_control\":%u,\"stack_network\":%u",
+    (unsigned)uxTaskGetStackHighWaterMark(controlTask), (unsigned)uxTaskGetStackHighWaterMark(networkTask));
+#  elif !defined(POOLSTAT_NATIVE)
+  n += snprintf(payload + n, sizeof(payload) - n, ",\"stack_loop\":%u", (unsigned)uxTaskGetStackHighWaterMark(NULL));
+#  endif
+  snprintf(payload + n, sizeof(payload) - n, ",\"alarm\":%s}", memoryAlarm.on() ? "true" : "false");
+  mqttClient.publish(MQTT_TOPIC_DIAG_MEMORY, payload);  // Best effort, as timing
+#  ifdef USE_MEMORY_SITES
+  _publishMemorySites();
+#  endif
+}
+#endif
+
+// Write out queued log lines, only as fast as Serial takes them without
+// blocking (a line may go out over several calls), and publish those up
+// to LOG_MQTT_LEVEL; with RemoteDebug, it writes to telnet and Serial
+static void log_update() {
+  static uint8_t written = 0;  // Of the front line
+  static bool published = false;
+  uint32_t dropped = logRing.takeDropped();
+  if (dropped)
+    LOG_W(SYSTEM, "Dropped %u log messages", (unsigned)dropped);
+
+  const decltype(logRing)::Entry *e;
+  while ((e = logRing.peek())) {
+    if (!published) {
+      if (e->level <= LOG_MQTT_LEVEL && mqttClient.connected())
+        mqttClient.publish(MQTT_TOPIC_DIAG_LOG, (const uint8_t *)e->text, e->length - 2);  // Best effort, no line ending
+      published = true;
+    }
+#ifdef USE_REMOTEDEBUG
+    rdbg.write((const uint8_t *)e->text, e->length);
+#else
+    size_t room = max(Serial.availableForWrite(), 0);
+    written += Serial.write((const uint8_t *)e->text + written, min(room, (size_t)(e->length - written)));
+    if (written < e->length)
+      break;
+#endif
+    written = 0;
+    published = false;
+    logRing.pop();
+  }
+}
+
+// Periodic job; everything that needs polling
+static void network_poll() {
+  TIMED(networkTiming, TIMER_WIFI, wifi_update());
+  if (wifi_connected()) {
+    if (!mqttClient.connected() && !networkScheduler.pending(mqttReconnectJob))
+      networkScheduler.start(mqttReconnectJob);
+    TIMED(networkTiming, TIMER_NTP, ntpClient.update());
+    TIMED(networkTiming, TIMER_OTA, ArduinoOTA.handle());
+    TIMED(networkTiming, TIMER_MQTT_LOOP, mqttClient.loop());
+    TIMED(networkTiming, TIMER_OUTBOX, mqttOutbox.flush(MQTT_OUTBOX_FLUSH_BATCH));
+#ifdef USE_TELEMETRY_FRAME
+    TIMED(networkTiming, TIMER_OUTBOX, telemetry_flush());
+#endif
+#ifdef USE_HISTORY
+    TIMED(networkTiming, TIMER_OUTBOX, history_update());
+#endif
+  }
+#ifdef USE_REMOTEDEBUG
+  rdbg.handle();
+#endif
+
+  TIMED(networkTiming, TIMER_STATUS, status_update());
+#ifdef USE_TRACE
+  trace_update();
+#endif
+  // Status messages (see _wifiBegin(), mqtt_reconnect()) show up right
+  // away, not just on periodic display updates
+  TIMED(networkTiming, TIMER_DISPLAY, screen.flush(u8x8));
+#ifdef USE_LOOP_TIMING
+  diag_update();
+#endif
+  log_update();
+}
+
+static job_id_t networkPollJob;
+
+static void network_setup() {
+  networkPollJob = networkScheduler.every(NETWORK_POLL_INTERVAL_MS, network_poll);
+#ifdef USE_LOOP_TIMING
+  networkScheduler.every(DIAG_UPDATE_INTERVAL_SEC * 1000, diag_request, DIAG_UPDATE_INTERVAL_SEC * 1000);
+#endif
+#ifdef USE_MEMORY_STATS
+  networkScheduler.every(MEMORY_CHECK_INTERVAL_SEC * 1000, memory_update, MEMORY_CHECK_INTERVAL_SEC * 1000);
+#endif
+#if defined(USE_MEMORY_SITES) && defined(POOLSTAT_NATIVE)
+  NativeHAL::onAllocate = _countAllocation;
+#endif
+}
+
+// Runs whatever network jobs are due, and returns msec until the next one
+static uint32_t network_update() {
+  TIME_SCOPE(networkTiming, TIMER_NETWORK_PASS);
+#ifdef USE_LOOP_TIMING
+  networkTiming.poll();
+#endif
+  return networkScheduler.run();
+}
+
+// Sleep time for an idle period; never more than MAX_IDLE_MS
+static inline uint32_t _idleMs(uint32_t idle) {
+  return (idle < MAX_IDLE_MS) ? idle : MAX_IDLE_MS;
+}
+
+#ifdef USE_POWER_SAVE
+static void power_setup() {
+#  ifdef CONFIG_PM_ENABLE
+  esp_pm_config_esp32_t pm;
+  pm.max_freq_mhz = POWER_MAX_CPU_FREQ_MHZ;
+  pm.min_freq_mhz = POWER_MIN_CPU_FREQ_MHZ;
+#    ifdef CONFIG_FREERTOS_USE_TICKLESS_IDLE
+  pm.light_sleep_enable = true;
+#    else
+  pm.light_sleep_enable = false;
+#    endif
+  esp_err_t err = esp_pm_configure(&pm);
+  if (err != ESP_OK) {
+    LOG_E(SYSTEM, "Power management setup failed, err=%d", (int)err);
+  }
+#  else
+  // Stock Arduino core SDK is built without power management, so just a
+  // fixed, lower clock; tasks still block when idle
+  setCpuFrequencyMhz(POWER_MIN_CPU_FREQ_MHZ);
+#  endif
+  LOG_I(SYSTEM, "Power save on, CPU at %u MHz", (unsigned)getCpuFrequencyMhz());
+}
+#endif
+
+#ifdef USE_RTOS_TASKS
+// Rounds up, and at least one tick, to let the IDLE task run (watchdog)
+static inline TickType_t _idleTicks(uint32_t idle) {
+  TickType_t ticks = (_idleMs(idle) + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+  return (ticks > 0) ? ticks : 1;
+}
+
+static void control_task(void *param) {
+  for (;;)
+    ulTaskNotifyTake(pdTRUE, _idleTicks(control_update()));  // Or until _postCommand()
+}
+
+// Block until the next job is due or, with USE_POWER_SAVE, until MQTT
+// data arrives; returns true in the latter case
+static bool _networkIdle(uint32_t idle) {
+#ifdef USE_POWER_SAVE
+  int fd = mqttClient.connected() ? mqttWifiClient.fd() : -1;
+  if (fd >= 0 && idle > 0) {
+    if (mqttWifiClient.available())
+      return true;  // Already buffered (PubSubClient reads one packet per loop())
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(fd, &readable);
+    uint32_t ms = _idleMs(idle);
+    struct timeval timeout = { (time_t)(ms / 1000), (suseconds_t)((ms % 1000) * 1000) };
+    return select(fd + 1, &readable, NULL, NULL, &timeout) > 0;
+  }
+#endif
+  vTaskDelay(_idleTicks(idle));
+  return false;
+}
+
+static void network_task(void *param) {
+  for (;;) {
+    if (_networkIdle(network_update()))
+      networkScheduler.start(networkPollJob);  // Handle traffic now; polling resumes from here
+  }
+}
+
+static void tasks_setup() {
+  xTaskCreatePinnedToCore(control_task, "control", CONTROL_TASK_STACK_SIZE, NULL,
+    CONTROL_TASK_PRIORITY, &controlTask, CONTROL_TASK_CORE);
+  xTaskCreatePinnedToCore(network_task, "network", NETWORK_TASK_STACK_SIZE, NULL,
+    NETWORK_TASK_PRIORITY, &networkTask, NETWORK_TASK_CORE);
+  LOG_I(SYSTEM, "Control and network tasks started");
+}
+#endif
+
 /***************************************************************************
  *
  ***************************************************************************/
@@ -623,9 +2004,15 @@ static void thermostat_update() {
 void setup() {
   Serial.begin(9600);
   Serial.println("BOOT");
+#ifdef USE_POWER_SAVE
+  power_setup();
+#endif
   display_setup();
   wifi_setup();
   mqtt_setup();
+#ifdef USE_TRACE
+  trace_setup();
+#endif
   thermostat_setup();
 #ifdef HAS_WATER_REFILL
   refill_setup();
@@ -635,27 +2022,21 @@ void setup() {
   remotedebug_setup();
 #endif
   ntp_setup();
+  network_setup();
+#ifdef USE_RTOS_TASKS
+  tasks_setup();
+#endif
+#ifdef POOLSTAT_NATIVE
+  NativeHAL::onExit = report_print;
+#endif
 }
 
 void loop() {
-  if (!WiFi.isConnected())  {
-    wifi_reconnect();
-    // TODO -- Do we also have to restart NTP and/or OTA?
-  }
-  if (!mqttClient.connected()) mqtt_reconnect();
-  ntpClient.update();
-  ArduinoOTA.handle();
-#ifdef USE_REMOTEDEBUG
-  rdbg.handle();
-#endif
-  mqttClient.loop();
-
-  thermostat_update();
-#ifdef HAS_WATER_REFILL
-  refill_update();
+#ifdef USE_RTOS_TASKS
+  vTaskDelete(NULL);  // All work happens in the tasks started by setup()
+#else
+  uint32_t idle = network_update();
+  idle = min(idle, control_update());  // After network side, so new commands are carried out right away
+  delay(_idleMs(idle));  // Nothing is due until then
 #endif
-  display_update();
-  mqtt_update_values();
-
-  //yield();
 }
\ No newline at end of file